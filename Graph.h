@@ -1,6 +1,8 @@
 #pragma once
 #include "./core.h"
 #include <algorithm>
+#include <span>
+#include <utility>
 #include "stdio.h"
 
 namespace APSP{
@@ -34,28 +36,179 @@ namespace APSP{
 		};
 	};
 
-	//The graph, stores both edges and vertex neighbours
+	//Degrees the searches are built for, so their loops over a vertex's neighbours have a fixed length and unroll
+	using SpecialisedDegrees = std::integer_sequence<int,
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32
+	>;
+
+	//Returns true if the degree is one of the sequence's
+	template<int... Degrees>
+	constexpr bool isSpecialised(int degree, std::integer_sequence<int, Degrees...>){
+		return ((degree == Degrees) || ...);
+	};
+
+	//Returns true if the searches are built for graphs where every vertex has this degree
+	constexpr bool isSpecialised(int degree){
+		return isSpecialised(degree, SpecialisedDegrees{});
+	};
+
+	//Calls f with std::integral_constant<int, degree> if the degree is one of the sequence's, otherwise with 0
+	template<typename F, int... Degrees>
+	void withDegree(int degree, F&& f, std::integer_sequence<int, Degrees...>){
+		bool found = ((degree == Degrees && (f(std::integral_constant<int, Degrees>{}), true)) || ...);
+		if(!found){ f(std::integral_constant<int, 0>{}); }
+	};
+
+	/*
+	* Calls f with std::integral_constant<int, degree> if the searches are built for that degree, otherwise
+	* with std::integral_constant<int, 0>, which picks the searches that read each vertex's degree as they go.
+	*/
+	template<typename F>
+	void withDegree(int degree, F&& f){
+		withDegree(degree, f, SpecialisedDegrees{});
+	};
+
+	/*
+	* The graph, stores both edges and vertex neighbours.
+	* The neighbours are kept in compressed sparse row form: every neighbour list is stored back to back
+	* in one array, so traversal stays in contiguous memory and copying a graph copies three flat arrays.
+	* The arrays are normally owned by the graph, but a graph can also be a view of arrays held elsewhere,
+	* such as memory shared between processes. Copying a view makes a graph that owns its own arrays.
+	*/
 	struct Graph{
-		Array<Edge> e;
-		Array<Array<Vertex>> v;
+		std::span<Edge> e;
+		//Index in adjacency where each vertex's neighbours start, with an extra entry for the end of the last vertex
+		std::span<int> offsets;
+		//The neighbours of every vertex, in vertex order
+		std::span<Vertex> adjacency;
+		/*
+		* The degree of every vertex when they all have the same one, otherwise 0. Moves never change a
+		* vertex's degree, so it is only found when the graph is built, and the searches use it to pick the
+		* version built for that degree. Setting it to 0 makes them use the general version.
+		*/
+		int fixedDegree = 0;
 
 		//Construct a graph with both the edges and vertex neighbours. These aren't verified.
-		Graph(Array<Edge> e, Array<Array<Vertex>> v) : e(e), v(v){};
+		Graph(Array<Edge> e, const Array<Array<Vertex>>& v) : ownedEdges(std::move(e)), ownedOffsets{0}{
+			for(auto& neighbours : v){
+				ownedAdjacency.insert(ownedAdjacency.end(), neighbours.begin(), neighbours.end());
+				ownedOffsets.push_back((int)ownedAdjacency.size());
+			}
+			own();
+			fixedDegree = findFixedDegree();
+		};
 
 		//Construct a graph from only a set of edges. The vertex neighbours will be generated.
-		Graph(Array<Edge> e) : e(e), v(){
-			for(auto edge : e){
-				//Vertices are only defined by their index, so we resize to the largest one seen
-				while(edge.first >= (int)v.size()){
-					v.push_back({});
-				}
-				v[edge.first].push_back({edge.second});
+		Graph(Array<Edge> e) : ownedEdges(std::move(e)), ownedAdjacency(2 * ownedEdges.size()){
+			//Vertices are only defined by their index, so we size to the largest one seen
+			int order = 0;
+			for(auto edge : ownedEdges){
+				order = std::max(order, std::max(edge.first, edge.second) + 1);
+			}
 
-				while(edge.second >= (int)v.size()){
-					v.push_back({});
-				}
-				v[edge.second].push_back({edge.first});
+			//Count the degree of each vertex, then turn the counts into starting offsets
+			ownedOffsets.assign(order + 1, 0);
+			for(auto edge : ownedEdges){
+				++ownedOffsets[edge.first + 1];
+				++ownedOffsets[edge.second + 1];
+			}
+			for(int i = 0; i != order; ++i){
+				ownedOffsets[i + 1] += ownedOffsets[i];
+			}
+
+			//Fill each vertex's neighbours in the order the edges were given
+			Array<int> filled(ownedOffsets.begin(), ownedOffsets.end() - 1);
+			for(auto edge : ownedEdges){
+				ownedAdjacency[filled[edge.first]++] = {edge.second};
+				ownedAdjacency[filled[edge.second]++] = {edge.first};
+			}
+			own();
+			fixedDegree = findFixedDegree();
+		};
+
+		//Construct a view of arrays held elsewhere, which must outlive the graph and any moves made on it
+		Graph(std::span<Edge> e, std::span<int> offsets, std::span<Vertex> adjacency) :
+			e(e),
+			offsets(offsets),
+			adjacency(adjacency),
+			fixedDegree(findFixedDegree())
+		{};
+
+		//Copies always own their arrays, even when copying a view
+		Graph(const Graph& other) :
+			fixedDegree(other.fixedDegree),
+			ownedEdges(other.e.begin(), other.e.end()),
+			ownedOffsets(other.offsets.begin(), other.offsets.end()),
+			ownedAdjacency(other.adjacency.begin(), other.adjacency.end())
+		{
+			own();
+		};
+
+		Graph& operator=(const Graph& other){
+			if(this != &other){
+				ownedEdges.assign(other.e.begin(), other.e.end());
+				ownedOffsets.assign(other.offsets.begin(), other.offsets.end());
+				ownedAdjacency.assign(other.adjacency.begin(), other.adjacency.end());
+				own();
+				fixedDegree = other.fixedDegree;
 			}
+			return *this;
+		};
+
+		//Moving an array keeps its memory, so the views stay pointing at it
+		Graph(Graph&&) = default;
+		Graph& operator=(Graph&&) = default;
+
+		//Returns the number of vertices
+		int order() const{
+			return (int)offsets.size() - 1;
+		};
+
+		//Returns the number of neighbours of vertex v
+		int degree(int v) const{
+			return offsets[v + 1] - offsets[v];
+		};
+
+		//Returns the neighbours of vertex v
+		std::span<const Vertex> neighbours(int v) const{
+			return {adjacency.data() + offsets[v], adjacency.data() + offsets[v + 1]};
+		};
+
+		//Returns the number of neighbours of vertex v, which is Degree unless Degree is 0
+		template<int Degree>
+		int degree(int v) const{
+			if constexpr(Degree == 0){ return degree(v); } else{ return Degree; }
+		};
+
+		/*
+		* Returns the neighbours of vertex v in a graph where every vertex has Degree neighbours. They start at
+		* v * Degree, and the span has a fixed size, so loops over it unroll. With a Degree of 0 this is the
+		* same as neighbours(v).
+		*/
+		template<int Degree>
+		auto neighbours(int v) const{
+			if constexpr(Degree == 0){
+				return neighbours(v);
+			} else{
+				return std::span<const Vertex, Degree>{adjacency.data() + (size_t)v * Degree, Degree};
+			}
+		};
+
+		//Returns the neighbours of vertex v so they can be modified
+		std::span<Vertex> neighbours(int v){
+			return {adjacency.data() + offsets[v], adjacency.data() + offsets[v + 1]};
+		};
+
+		/*
+		* Returns true if the edge's vertices are neighbours. The neighbour lists are kept up to date by every
+		* exchange, so they double as an index of the edges, and only the shorter of the two lists is read.
+		*/
+		bool hasEdge(Edge edge) const{
+			auto a = edge.first;
+			auto b = edge.second;
+			if(degree(a) > degree(b)){ std::swap(a, b); }
+			auto n = neighbours(a);
+			return std::find(n.begin(), n.end(), Vertex{b}) != n.end();
 		};
 
 		//Prints all edges then vertices and connections
@@ -66,13 +219,35 @@ namespace APSP{
 			}
 
 			printf("\nVertices:\n");
-			for(uint i = 0; i != v.size(); ++i){
+			for(int i = 0; i != order(); ++i){
 				printf("%d: ", i);
-				for(auto& neighbour : v[i]){
+				for(auto& neighbour : neighbours(i)){
 					printf("%d, ", neighbour.value);
 				}
 				printf("\n");
 			}
 		};
+
+		//Returns the degree every vertex has, or 0 if they differ
+		int findFixedDegree() const{
+			if(order() == 0){ return 0; }
+			int d = degree(0);
+			for(int v = 1; v != order(); ++v){
+				if(degree(v) != d){ return 0; }
+			}
+			return d;
+		};
+
+		//The arrays of a graph that owns them, empty for a view
+		Array<Edge> ownedEdges;
+		Array<int> ownedOffsets;
+		Array<Vertex> ownedAdjacency;
+
+		//Points the views at the owned arrays
+		void own(){
+			e = ownedEdges;
+			offsets = ownedOffsets;
+			adjacency = ownedAdjacency;
+		};
 	};
 }
\ No newline at end of file
@@ -1,5 +1,7 @@
 #pragma once
 #include <random>
+#include <sstream>
+#include <string>
 
 //Get the next value from the random device
 int getRandSeed(){
@@ -21,6 +23,19 @@ struct Random{
 
 	//Generates the next double in the range [0,1].
 	double inline nextProb(){ return probDist(gen); }
+
+	//Returns the state of the generator and distributions, as text, so the sequence can be carried on later
+	std::string state() const{
+		std::ostringstream out;
+		out << gen << ' ' << intDist << ' ' << boolDist << ' ' << probDist;
+		return out.str();
+	};
+
+	//Carries on the sequence from a state returned by state
+	void restore(const std::string& state){
+		std::istringstream in(state);
+		in >> gen >> intDist >> boolDist >> probDist;
+	};
 };
 
 //Get the next random integer
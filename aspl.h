@@ -0,0 +1,144 @@
+#pragma once
+#include "./bfs.h"
+#include "./multiSourceBFS.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <omp.h>
+
+namespace APSP{
+	//Checks if all distances are valid (none are -1)
+	bool isValid(const Array<int>& dist){
+		for(auto d : dist){ if(d == -1){ return false; } }
+		return true;
+	}
+
+	//The ways calculateASPL can find the distances between vertices
+	enum class ASPLEngine{
+		PerSource, //A separate breadthFirstSearch from every source, choosing SourceParallel or LevelParallel
+		BitParallel, //laneWidth sources per search, see multiSourceBFS.h
+		SourceParallel, //Each thread runs whole single threaded searches from its share of the sources
+		LevelParallel, //One source at a time, with the threads sharing each level of the search
+	};
+
+	//Smallest graph where the levels of a single search are large enough to be worth splitting between threads
+	constexpr int levelParallelOrder = 1 << 14;
+
+	/*
+	* Picks how a PerSource search is parallelised. Sharing the sources between threads avoids starting
+	* threads and merging their results on every level, so it is used unless there are too few sources
+	* to go around and the graph is large enough for its levels to be split instead.
+	*/
+	ASPLEngine perSourceEngine(const Graph& graph, int sources){
+		bool fewSources = sources < omp_get_max_threads();
+		return fewSources && graph.order() >= levelParallelOrder ? ASPLEngine::LevelParallel : ASPLEngine::SourceParallel;
+	};
+
+	/*
+	* Finds the sum of the distances from every source in [startVertex, endVertex), with each thread running
+	* whole searches using its own reused buffers. The search stops early if the graph is disconnected, or
+	* the total passes the cutoff.
+	*/
+	DistanceSums sourceParallelBFS(const Graph& graph, int startVertex, int endVertex, BFSMode mode, Cutoff cutoff = {}){
+		long long total = 0;
+		int diameter = 0;
+		//Progress shared between threads, so any of them can stop the rest
+		std::atomic<long long> found{0};
+		std::atomic<int> searched{0};
+		std::atomic<bool> stop{false};
+		std::atomic<bool> disconnected{false};
+		std::atomic<bool> exceeded{false};
+	#pragma omp parallel reduction(+:total) reduction(max:diameter)
+		{
+			thread_local Array<int> distance;
+			thread_local BFSBuffers buffers;
+		#pragma omp for schedule(dynamic, 1)
+			for(int s = startVertex; s < endVertex; ++s){
+				if(stop.load(std::memory_order_relaxed)){ continue; }
+				breadthFirstSearch(graph, {s}, distance, buffers, mode, false);
+				//If the graph is disconnected then not all pairs have paths
+				if(!isValid(distance)){
+					disconnected = true;
+					stop = true;
+					continue;
+				}
+				long long sum = std::accumulate(distance.begin(), distance.end(), 0ll);
+				total += sum;
+				diameter = std::max(diameter, *std::max_element(distance.begin(), distance.end()));
+				if(cutoff.active()){
+					auto soFar = found += sum;
+					auto done = searched += 1;
+					if(cutoff.exceeded(soFar, endVertex - startVertex - done)){
+						exceeded = true;
+						stop = true;
+					}
+				}
+			}
+		}
+		return DistanceSums{total, diameter, !disconnected, exceeded};
+	};
+
+	/*
+	* Finds the average shortest path length between all pairs of vertices, as well as the diameter.
+	* If the sum of the distances passes the cutoff, the search stops and the ASPL is infinite.
+	*/
+	auto calculateASPL(
+		const APSP::Graph& graph,
+		int startVertex,
+		int endVertex,
+		ASPLEngine engine = ASPLEngine::BitParallel,
+		BFSMode bfsMode = BFSMode::TopDown,
+		Cutoff cutoff = {}
+	){
+		//Struct so we can return multiple values
+		struct Result{ double aspl; int diameter; };
+
+		//The average for a vertex is the sum of its distance to all other vertices, so we subtract 1
+		auto div = double(graph.order() - 1);
+		//A process can be left with no sources when there are more processes than sources
+		if(startVertex == endVertex){ return Result{0, 0}; }
+
+		if(engine == ASPLEngine::BitParallel){
+			auto sums = multiSourceBFS(graph, startVertex, endVertex, cutoff);
+			if(!sums.connected || sums.exceeded){ return Result{INFINITY, 0}; }
+			return Result{sums.total / div / graph.order(), sums.diameter};
+		}
+
+		if(engine == ASPLEngine::PerSource){
+			engine = perSourceEngine(graph, endVertex - startVertex);
+		}
+		if(engine == ASPLEngine::SourceParallel){
+			auto sums = sourceParallelBFS(graph, startVertex, endVertex, bfsMode, cutoff);
+			if(!sums.connected || sums.exceeded){ return Result{INFINITY, 0}; }
+			return Result{sums.total / div / graph.order(), sums.diameter};
+		}
+
+		//Perform a test on the first vertex
+		auto dists = APSP::breadthFirstSearch(graph, {startVertex}, bfsMode);
+		//If the graph is disconnected then not all pairs have paths
+		if(!isValid(dists)){ return Result{INFINITY, 0}; }
+
+		//Intial values for what we are trying to find
+		int diameter = *std::max_element(dists.begin(), dists.end());
+		double total = std::accumulate(dists.begin(), dists.end(), 0) / div;
+		//Exact sum of the distances, checked against the cutoff
+		long long sum = std::accumulate(dists.begin(), dists.end(), 0ll);
+		if(cutoff.exceeded(sum, endVertex - startVertex - 1)){ return Result{INFINITY, 0}; }
+
+		//Add the average for a given vertex to all others to the total
+		for(uint i = startVertex + 1; i != (uint)endVertex; ++i){
+			dists = APSP::breadthFirstSearch(graph, {(int)i}, bfsMode);
+			//Add average distance to total
+			total += std::accumulate(dists.begin(), dists.end(), 0) / div;
+			sum += std::accumulate(dists.begin(), dists.end(), 0ll);
+			if(cutoff.exceeded(sum, endVertex - i - 1)){ return Result{INFINITY, 0}; }
+			//Only update the diameter if it is greater than our current
+			int newDiameter = *std::max_element(dists.begin(), dists.end());
+			diameter = diameter < newDiameter ? newDiameter : diameter;
+		}
+		return Result{total / graph.order(), diameter};
+	};
+};
\ No newline at end of file
@@ -0,0 +1,228 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./generator.h"
+#include "./graphFile.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <sstream>
+#include <stdio.h>
+#include <omp.h>
+
+namespace APSP{
+	/*
+	* One graph of a batch, read from a file or generated as by --generate. Its cost is its order times its
+	* number of edges, as each energy calculation searches every edge from every source.
+	*/
+	struct Instance{
+		string path;
+		GraphKind generate = GraphKind::None;
+		int order = 0;
+		int degree = 0;
+		double cost = 0;
+	};
+
+	/*
+	* Reads a manifest of one instance per line: the path to a graph file, or "random order degree" or
+	* "circulant order degree" followed by the path to save it to, which can be left out as for --generate.
+	* Blank lines and lines starting with # are skipped. Returns nothing if a line isn't an instance, or two
+	* instances have the same path apart from its file type, as they would share the graph, result,
+	* checkpoint and telemetry files named after it.
+	*/
+	std::optional<Array<Instance>> parseManifest(std::span<const char> bytes){
+		Array<Instance> instances;
+		std::istringstream text(string(bytes.begin(), bytes.end()));
+		string line;
+		while(std::getline(text, line)){
+			std::istringstream words(line);
+			string first;
+			if(!(words >> first) || first[0] == '#'){ continue; }
+			Instance instance{};
+			if(first == "random" || first == "circulant"){
+				instance.generate = first == "random" ? GraphKind::Random : GraphKind::Circulant;
+				if(!(words >> instance.order >> instance.degree) || instance.order < 2 || instance.degree < 1){
+					return std::nullopt;
+				}
+				if(!(words >> instance.path)){
+					instance.path = generatedPath(instance.generate, instance.order, instance.degree);
+				}
+			} else{
+				instance.path = first;
+			}
+			instances.push_back(instance);
+		}
+
+		//The files made for an instance replace the last four characters of its path if they are a file type
+		auto stem = [](const string& path){
+			return path.size() > 4 && path[path.size() - 4] == '.' ? path.substr(0, path.size() - 4) : path;
+		};
+		Array<string> stems;
+		for(auto& instance : instances){
+			stems.push_back(stem(instance.path));
+		}
+		std::sort(stems.begin(), stems.end());
+		if(std::adjacent_find(stems.begin(), stems.end()) != stems.end()){ return std::nullopt; }
+		return instances;
+	};
+
+	/*
+	* Finds the cost of each instance. A binary graph file's order and edges are read from its header, so only
+	* a text graph is read in full to count them. A file that can't be read costs nothing, failing once it is solved.
+	*/
+	void estimateCosts(Array<Instance>& instances){
+		for(auto& instance : instances){
+			double order = instance.order;
+			double edges = double(instance.order) * instance.degree / 2;
+			if(instance.generate == GraphKind::None){
+				if(auto header = readGraphHeader(instance.path)){
+					order = (double)header->n;
+					edges = (double)header->m;
+				} else{
+					auto read = readGraph(instance.path).value_or(Array<Edge>{});
+					order = 0;
+					for(auto edge : read){
+						order = std::max<double>(order, std::max(edge.first, edge.second) + 1);
+					}
+					edges = (double)read.size();
+				}
+			}
+			instance.cost = order * edges;
+		}
+	};
+
+	//Returns the order the instances are handed out in, most costly first, so the last to finish are the quickest
+	Array<int> largestFirst(const Array<Instance>& instances){
+		Array<int> order(instances.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b){ return instances[a].cost > instances[b].cost; });
+		return order;
+	};
+
+	/*
+	* Returns the number of processes each instance is solved on, in proportion to its cost so each takes
+	* about as long. The most costly is given most, and none are given fewer than least or more than the
+	* workers there are.
+	*/
+	Array<int> groupSizes(const Array<Instance>& instances, int most, int least, int workers){
+		double largest = 0;
+		for(auto& instance : instances){
+			largest = std::max(largest, instance.cost);
+		}
+		most = std::max(most, least);
+		Array<int> sizes(instances.size());
+		for(size_t i = 0; i != instances.size(); ++i){
+			int size = largest > 0 ? (int)std::lround(most * instances[i].cost / largest) : least;
+			sizes[i] = std::clamp(size, std::min(least, workers), std::min(most, workers));
+		}
+		return sizes;
+	};
+
+	/*
+	* Hands the instances out in the order given, each to as many of the processes waiting as its size, until
+	* there are none left, then tells every process to stop. An instance waits for enough processes to finish
+	* rather than letting smaller ones past, so the largest aren't left until last. Each process is sent the
+	* instance and the ranks of its group. The first process of each group reports what solving it returned,
+	* which is printed as it comes in. Returns the number of instances that failed.
+	*/
+	int schedule(const Array<Instance>& instances, const Array<int>& order, const Array<int>& sizes){
+		int size = mpi::Comm::size();
+		//The processes waiting for an instance, lowest rank first so groups are made of neighbours where they can be
+		Array<int> idle(size - 1);
+		std::iota(idle.begin(), idle.end(), 1);
+		Array<Array<int>> groups(instances.size());
+		Array<double> started(instances.size(), 0);
+		size_t next = 0;
+		int running = 0;
+		int failed = 0;
+		for(;;){
+			while(next != order.size() && sizes[order[next]] <= (int)idle.size()){
+				int instance = order[next++];
+				auto& group = groups[instance];
+				group.assign(idle.begin(), idle.begin() + sizes[instance]);
+				idle.erase(idle.begin(), idle.begin() + sizes[instance]);
+				int message[2] = {instance, sizes[instance]};
+				for(int p : group){
+					mpi::send(message, 2, p);
+					mpi::send(group.data(), sizes[instance], p);
+				}
+				started[instance] = omp_get_wtime();
+				printf("Solving %s on %d process%s.\n", instances[instance].path.c_str(), sizes[instance], sizes[instance] == 1 ? "" : "es");
+				++running;
+			}
+			if(running == 0){ break; }
+
+			//The instance a group solved, and what solving it returned
+			int report[2];
+			mpi::receiveAny(report, 2);
+			auto [done, code] = report;
+			--running;
+			double seconds = omp_get_wtime() - started[done];
+			if(code == 0){
+				printf("Solved %s in %.1f seconds.\n", instances[done].path.c_str(), seconds);
+			} else{
+				printf("Failed to solve %s, with code %d.\n", instances[done].path.c_str(), code);
+				++failed;
+			}
+			idle.insert(idle.end(), groups[done].begin(), groups[done].end());
+			std::sort(idle.begin(), idle.end());
+		}
+
+		int stop[2] = {-1, 0};
+		for(int p = 1; p != size; ++p){
+			mpi::send(stop, 2, p);
+		}
+		return failed;
+	};
+
+	/*
+	* Solves the instances the scheduler hands this process, with solve(instance, comm), until it is told to
+	* stop. The processes of each group make a communicator of their own to solve it on, which only they take
+	* part in, so the other groups carry on. The group's first process reports back once it is solved.
+	*/
+	template<typename Solve>
+	void work(const Array<Instance>& instances, Solve&& solve){
+		for(;;){
+			int message[2];
+			mpi::receive(message, 2, 0);
+			auto [instance, count] = message;
+			if(instance == -1){ return; }
+			Array<int> group(count);
+			mpi::receive(group.data(), count, 0);
+			auto comm = mpi::Comm::create(group);
+			int report[2] = {instance, solve(instances[instance], comm)};
+			mpi::Comm::free(comm);
+			if(mpi::Comm::rank() == group[0]){
+				mpi::send(report, 2, 0);
+			}
+		}
+	};
+
+	/*
+	* Solves every instance, largest first, with solve(instance, comm), which returns 0 if it succeeds.
+	* Process 0 hands them out, and each is solved by a group of the other processes sized by groupSizes,
+	* from most for the most costly down to least. A single process has no one to hand them to, so solves
+	* every instance itself. Returns the number that failed on process 0. Must be called from every process.
+	*/
+	template<typename Solve>
+	int runBatch(Array<Instance> instances, int most, int least, Solve&& solve){
+		auto [rank, size] = mpi::Comm::info();
+		int failed = 0;
+		if(size == 1){
+			estimateCosts(instances);
+			for(int i : largestFirst(instances)){
+				printf("Solving %s.\n", instances[i].path.c_str());
+				failed += solve(instances[i], mpi::Comm::Comm::World) != 0;
+			}
+		} else if(rank == 0){
+			estimateCosts(instances);
+			failed = schedule(instances, largestFirst(instances), groupSizes(instances, most, least, size - 1));
+		} else{
+			work(instances, solve);
+		}
+		return failed;
+	};
+};
@@ -0,0 +1,345 @@
+//Times the parts of the solver over random regular graphs of several sizes, so a change to the searches,
+//the moves or the annealing can be measured. Each result is printed by process 0 as one line of JSON.
+
+#include "./edgeExchange.h"
+#include "./bfs.h"
+#include "./Graph.h"
+#include "./core.h"
+#include "./mpiWrapper.h"
+#include "./simulatedAnnealing.h"
+#include "./options.h"
+#include "./replicaExchange.h"
+#include "./sharedGraph.h"
+#include "./checkpoint.h"
+#include "./generator.h"
+#include "./telemetry.h"
+#include "./sampledEnergy.h"
+#include "./reorder.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+
+//Settings for a run of the benchmarks, read from the command line
+struct BenchOptions{
+	//Orders and degrees of the graphs, each order being tried with each degree
+	Array<int> orders = {1024, 4096};
+	Array<int> degrees = {4, 8};
+	//Numbers of threads per process to try
+	Array<int> threads = {1, 2, 4};
+	//Seed of the random graphs and moves, the same on every process
+	int seed = 1;
+	//Each timing is repeated until it has taken at least this many seconds
+	double minimumTime = 0.2;
+};
+
+//Printed when the arguments aren't valid
+const char* benchUsage =
+	"Usage: bench [options]\n"
+	"  --n orders                    Comma separated orders of the graphs (default 1024,4096)\n"
+	"  --degree degrees              Comma separated degrees of the graphs (default 4,8)\n"
+	"  --threads counts              Comma separated numbers of threads per process (default 1,2,4)\n"
+	"  --seed seed                   Seed of the random graphs and moves (default 1)\n"
+	"  --time seconds                Least time spent on each timing (default 0.2)\n";
+
+//Reads a comma separated list of positive integers. Returns false if it isn't one.
+bool parseList(const char* text, Array<int>& values){
+	values.clear();
+	for(;;){
+		char* end;
+		long value = strtol(text, &end, 10);
+		if(end == text || value <= 0){ return false; }
+		values.push_back((int)value);
+		if(*end == '\0'){ return true; }
+		if(*end != ','){ return false; }
+		text = end + 1;
+	}
+};
+
+//Reads the command line into the options. Returns false if the arguments aren't valid.
+bool parseBenchOptions(int argc, char** argv, BenchOptions& options){
+	for(int i = 1; i < argc; ++i){
+		if(i + 1 == argc){ return false; }
+		const char* value = argv[++i];
+		if(strcmp(argv[i - 1], "--n") == 0){
+			if(!parseList(value, options.orders)){ return false; }
+		} else if(strcmp(argv[i - 1], "--degree") == 0){
+			if(!parseList(value, options.degrees)){ return false; }
+		} else if(strcmp(argv[i - 1], "--threads") == 0){
+			if(!parseList(value, options.threads)){ return false; }
+		} else if(strcmp(argv[i - 1], "--seed") == 0){
+			options.seed = atoi(value);
+		} else if(strcmp(argv[i - 1], "--time") == 0){
+			options.minimumTime = atof(value);
+			if(options.minimumTime < 0){ return false; }
+		} else{
+			return false;
+		}
+	}
+	return true;
+};
+
+//Returns the seconds since an arbitrary point
+double now(){
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+};
+
+/*
+* Times the work, which does one unit each call, repeating it until it has taken at least the minimum time.
+* It is run once first to estimate how many repeats that needs, which every process agrees on, so work that
+* is collective can be timed too. The time is that of the slowest process. Must be called from every process.
+*/
+template<typename F>
+auto timeRepeated(double minimumTime, F work){
+	struct Result{
+		long long repeats;
+		double seconds;
+	};
+	double start = now();
+	work();
+	double estimate = now() - start;
+	mpi::allReduce(&estimate, 1, mpi::Op::Max);
+	long long repeats = std::max(1ll, (long long)std::ceil(minimumTime / std::max(estimate, 1e-9)));
+
+	mpi::Comm::barrier();
+	start = now();
+	for(long long i = 0; i != repeats; ++i){
+		work();
+	}
+	double seconds = now() - start;
+	mpi::allReduce(&seconds, 1, mpi::Op::Max);
+	return Result{repeats, seconds};
+};
+
+//Prints one result as a line of JSON, from process 0
+void report(const char* bench, int n, int degree, int threads, long long count, double seconds){
+	if(mpi::Comm::rank() != 0){ return; }
+	printf(
+		"{\"bench\":\"%s\",\"n\":%d,\"degree\":%d,\"threads\":%d,\"ranks\":%d,\"count\":%lld,\"seconds\":%.6f,\"rate\":%.3f}\n",
+		bench, n, degree, threads, mpi::Comm::size(), count, seconds, count / seconds
+	);
+	fflush(stdout);
+};
+
+/*
+* Prints the estimates of the energy from samples of the sources as a line of JSON, from process 0. Along
+* with the timing it holds the exact energy, the mean of the estimates and how far that is from the exact
+* energy, the mean variance each estimate reported, and the variance the estimates actually had.
+*/
+void reportSampled(
+	int n, int degree, int threads, double fraction, long long count, double seconds,
+	double exact, double mean, double variance, double observed
+){
+	if(mpi::Comm::rank() != 0){ return; }
+	printf(
+		"{\"bench\":\"aspl-sampled\",\"n\":%d,\"degree\":%d,\"threads\":%d,\"ranks\":%d,\"fraction\":%g,\"count\":%lld,\"seconds\":%.6f,\"rate\":%.3f,"
+		"\"exact\":%.9g,\"mean\":%.9g,\"bias\":%.3g,\"variance\":%.3g,\"observed_variance\":%.3g}\n",
+		n, degree, threads, mpi::Comm::size(), fraction, count, seconds, count / seconds,
+		exact, mean, mean - exact, variance, observed
+	);
+	fflush(stdout);
+};
+
+//Prints whether a run resumed from a checkpoint ended with the same graph as the run that saved it, as a line of JSON from process 0
+void reportResume(int n, int degree, int threads, int chains, int iteration, bool matches){
+	if(mpi::Comm::rank() != 0){ return; }
+	printf(
+		"{\"bench\":\"anneal-resume\",\"n\":%d,\"degree\":%d,\"threads\":%d,\"ranks\":%d,\"chains\":%d,\"iteration\":%d,\"matches\":%s}\n",
+		n, degree, threads, mpi::Comm::size(), chains, iteration, matches ? "true" : "false"
+	);
+	fflush(stdout);
+};
+
+//To build: mpicxx ./bench.cpp -std=c++2a -Wall -Wextra -O3 -fopenmp -o ./bench
+//To run: mpirun -np 2 ./bench --n 1024,4096 --degree 4,8 --threads 1,2
+int main(int argc, char** argv){
+	mpi::init(argc, argv);
+	auto [rank, size] = mpi::Comm::info();
+
+	BenchOptions bench{};
+	if(!parseBenchOptions(argc, argv, bench)){
+		if(rank == 0){
+			printf("Invalid arguments.\n%s", benchUsage);
+		}
+		return -2;
+	}
+
+	for(int n : bench.orders){
+		for(int degree : bench.degrees){
+			//Every process builds the same graph from the same seed
+			randomGenerator = Random{bench.seed};
+			auto generated = APSP::randomRegularGraph(n, degree, 10ll * n * degree);
+			if(!generated){
+				if(rank == 0){
+					printf("There is no graph of order %d and degree %d\n", n, degree);
+				}
+				continue;
+			}
+			auto& graph = *generated;
+
+			for(int threads : bench.threads){
+				omp_set_num_threads(threads);
+				APSP::Options options{};
+				options.threads = threads;
+
+				//Single searches on each process, each from the next source
+				for(auto mode : {APSP::BFSMode::TopDown, APSP::BFSMode::DirectionOptimizing}){
+					Array<int> distance;
+					APSP::BFSBuffers buffers;
+					int source = 0;
+					auto [repeats, seconds] = timeRepeated(bench.minimumTime, [&]{
+						APSP::breadthFirstSearch(graph, {source}, distance, buffers, mode);
+						source = (source + 1) % n;
+					});
+					report(mode == APSP::BFSMode::TopDown ? "bfs-topdown" : "bfs-direction", n, degree, threads, repeats, seconds);
+				}
+
+				//The whole energy, with the sources shared between the processes as the solver does
+				auto balance = APSP::balanceSources(n, mpi::Comm::Comm::World);
+				for(auto engine : {APSP::ASPLEngine::BitParallel, APSP::ASPLEngine::PerSource}){
+					options.engine = engine;
+					auto [repeats, seconds] = timeRepeated(bench.minimumTime, [&]{
+						APSP::calculateEnergy(graph, balance.start(), balance.end(), options, mpi::Comm::Comm::World);
+					});
+					report(engine == APSP::ASPLEngine::BitParallel ? "aspl-bitparallel" : "aspl-persource", n, degree, threads, repeats, seconds);
+				}
+				options.engine = APSP::ASPLEngine::BitParallel;
+
+				//The same energy with the searches for any degree, to compare with those built for this one
+				{
+					auto generic = graph;
+					generic.fixedDegree = 0;
+					auto [repeats, seconds] = timeRepeated(bench.minimumTime, [&]{
+						APSP::calculateEnergy(generic, balance.start(), balance.end(), options, mpi::Comm::Comm::World);
+					});
+					report("aspl-bitparallel-generic", n, degree, threads, repeats, seconds);
+				}
+
+				//The same searches and energy after relabelling the vertices so neighbours are close together
+				{
+					auto reordered = graph;
+					Array<int> original;
+					APSP::reorder(reordered, original, {}, APSP::SharedGraph{});
+					Array<int> distance;
+					APSP::BFSBuffers buffers;
+					int source = 0;
+					auto searches = timeRepeated(bench.minimumTime, [&]{
+						APSP::breadthFirstSearch(reordered, {source}, distance, buffers);
+						source = (source + 1) % n;
+					});
+					report("bfs-topdown-reordered", n, degree, threads, searches.repeats, searches.seconds);
+					auto energies = timeRepeated(bench.minimumTime, [&]{
+						APSP::calculateEnergy(reordered, balance.start(), balance.end(), options, mpi::Comm::Comm::World);
+					});
+					report("aspl-bitparallel-reordered", n, degree, threads, energies.repeats, energies.seconds);
+				}
+
+				//Estimates of the energy from a share of the sources, each from the next sample drawn
+				{
+					double exact = APSP::calculateEnergy(graph, balance.start(), balance.end(), options, mpi::Comm::Comm::World);
+					for(double fraction : {0.05, 0.25}){
+						int count = std::max(1, (int)std::ceil(fraction * n));
+						int seed = bench.seed;
+						double total = 0;
+						double squares = 0;
+						double variances = 0;
+						auto [repeats, seconds] = timeRepeated(bench.minimumTime, [&]{
+							auto sample = APSP::drawSample(n, count, seed++);
+							auto estimate = APSP::sampledEnergy(graph, sample, balance.start(), balance.end(), options, mpi::Comm::Comm::World);
+							total += estimate.energy;
+							squares += estimate.energy * estimate.energy;
+							variances += estimate.variance;
+						});
+						//The estimate made to count the repeats is included too
+						double samples = repeats + 1.0;
+						double mean = total / samples;
+						double observed = samples > 1 ? std::max(0.0, (squares - total * mean) / (samples - 1)) : 0;
+						reportSampled(n, degree, threads, fraction, repeats, seconds, exact, mean, variances / samples, observed);
+					}
+				}
+
+				//A complete graph has no move that keeps it simple, so there is nothing to anneal
+				if(degree == n - 1){ continue; }
+
+				//Choosing a move, which includes checking it against a multigraph, then making and undoing it
+				{
+					auto [repeats, seconds] = timeRepeated(bench.minimumTime, [&]{
+						auto move = APSP::chooseMove(graph);
+						APSP::applyMove(move, graph);
+						APSP::revertMove(move, graph);
+					});
+					report("moves", n, degree, threads, repeats, seconds);
+				}
+
+				//A whole run of the annealing on a copy, from the start temperature to the end, or until the graph reaches its lower bound
+				{
+					auto replicas = APSP::splitReplicas(1, options.exchangeInterval);
+					auto symmetry = APSP::findSymmetry(graph, 1);
+					APSP::SharedGraph shared{};
+					APSP::Checkpointer checkpoints{};
+					APSP::Telemetry telemetry{};
+					auto annealing = APSP::balanceSources(n, replicas.comm);
+					mpi::Comm::barrier();
+					double start = now();
+					auto annealed = APSP::simulatedAnnealing(graph, annealing, options, *symmetry, replicas, shared, checkpoints, telemetry);
+					double seconds = now() - start;
+					mpi::allReduce(&seconds, 1, mpi::Op::Max);
+					report("anneal", n, degree, threads, annealed.iterations, seconds);
+				}
+
+				//Runs of two chains that each save one checkpoint part way through, and runs resumed from them,
+				//which must end with the same graphs. A resumed run differs only if the step before the checkpoint
+				//left something behind, so several points are tried. Each chain needs a process of its own.
+				if(size >= 2){
+					constexpr int chains = 2;
+					auto anneal = [&](APSP::Graph start, APSP::Replicas& replicas, APSP::Checkpointer& checkpoints){
+						auto symmetry = APSP::findSymmetry(start, 1);
+						APSP::SharedGraph shared{};
+						APSP::Telemetry telemetry{};
+						auto annealing = APSP::balanceSources(n, replicas.comm);
+						return APSP::simulatedAnnealing(std::move(start), annealing, options, *symmetry, replicas, shared, checkpoints, telemetry).graph;
+					};
+					//The annealing runs 1000 iterations, so each of these is the only checkpoint saved
+					for(int saveAt : {500, 700, 900}){
+						auto replicas = APSP::splitReplicas(chains, options.exchangeInterval);
+						int chainRank = mpi::Comm::rank(replicas.comm);
+						APSP::Checkpointer checkpoints{};
+						checkpoints.path = "bench.chain" + std::to_string(replicas.chain) + ".ckpt";
+						checkpoints.interval = saveAt;
+						checkpoints.writer = chainRank == 0;
+						auto full = anneal(graph, replicas, checkpoints);
+						replicas.release();
+
+						//The first process of each chain reads its checkpoint and sends it to the rest, as the solver does
+						Array<char> bytes;
+						int length = 0;
+						if(chainRank == 0){
+							bytes = APSP::readFile(checkpoints.path).value_or(Array<char>{});
+							length = (int)bytes.size();
+							std::remove(checkpoints.path.c_str());
+						}
+						replicas = APSP::splitReplicas(chains, options.exchangeInterval);
+						mpi::broadcast(&length, 0, replicas.comm);
+						bytes.resize(length);
+						mpi::broadcast(bytes.data(), length, MPI_BYTE, 0, replicas.comm);
+						APSP::Checkpointer resuming{};
+						resuming.resumed = APSP::deserialise(bytes);
+						//A run that stopped at the lower bound before the checkpoint has nothing to resume
+						int saved = resuming.resumed.has_value();
+						mpi::allReduce(&saved, 1, mpi::Op::And);
+						if(saved){
+							auto resumed = anneal(APSP::Graph{resuming.resumed->edges}, replicas, resuming);
+							reportResume(n, degree, threads, chains, saveAt, std::ranges::equal(resumed.e, full.e));
+						}
+						replicas.release();
+					}
+				}
+			}
+		}
+	}
+	mpi::finalise();
+	return 0;
+};
\ No newline at end of file
@@ -2,16 +2,20 @@
 #include "./core.h"
 #include "./Graph.h"
 
+#include <cstdint>
+#include <omp.h>
+
 namespace APSP{
 	//Returns the neigbours of the given vertex v in the graph
-	const Array<Vertex>& getNeighbours(Vertex v, const Graph& graph){
-		return graph.v[v.value];
+	std::span<const Vertex> getNeighbours(Vertex v, const Graph& graph){
+		return graph.neighbours(v.value);
 	};
 
 	/*
 	* For every vertex in the frontier, updates the distance to all the neighbours if it needs to.
 	* Returns the vertices that had their distance updated.
 	*/
+	template<int Degree>
 	void topDownStep(
 		const Graph& graph,
 		const Array<Vertex>& frontier,
@@ -19,7 +23,7 @@ namespace APSP{
 		Array<int>& distance
 	){
 		for(auto v : frontier){
-			for(auto n : getNeighbours(v, graph)){
+			for(auto n : graph.neighbours<Degree>(v.value)){
 				//Only write to the distance if it was unevealuated (-1)
 				if(distance[n.value] == -1){
 					distance[n.value] = distance[v.value] + 1;
@@ -37,58 +41,237 @@ namespace APSP{
 
 	/*
 	* For every vertex in the frontier, updates the distance to all the neighbours if it needs to.
-	* This is parallelised using OpenMP.
+	* This is parallelised using OpenMP. Each thread collects the vertices it reaches in its own buffer, kept
+	* between levels, and the buffers are then copied into next side by side at offsets found by a prefix
+	* sum of their sizes, so no thread waits on another to add to next.
 	* Returns the vertices that had their distance updated.
 	*/
+	template<int Degree>
 	void topDownStepPar(
 		const Graph& graph,
 		const Array<Vertex>& frontier,
 		Array<Vertex>& next,
 		Array<int>& distance
 	){
-	#pragma omp parallel for schedule(dynamic, 2)
-		for(uint j = 0; j < frontier.size(); ++j){
-			auto v = frontier[j];
+		auto start = next.size();
+		//Where each thread's vertices start in next, after the prefix sum
+		Array<size_t> offsets(omp_get_max_threads() + 1, 0);
+	#pragma omp parallel
+		{
 			//Create a thread local array of next vertices
-			Array<Vertex> local_next{};
-			auto neighbours = getNeighbours(v, graph);
-			for(uint i = 0; i < neighbours.size(); ++i){
-				auto n = neighbours[i];
-				//Only write to the distance if it was unevealuated (-1). This is done atomically
-				if(compareAndSwap(
-					&(distance[n.value]),
-					-1,
-					distance[v.value] + 1
-				)){
-					//Store the value for the next frontier
-					local_next.push_back(n);
+			thread_local Array<Vertex> localNext;
+			localNext.resize(0);
+		#pragma omp for schedule(dynamic, 64) nowait
+			for(uint j = 0; j < frontier.size(); ++j){
+				auto v = frontier[j];
+				for(auto n : graph.neighbours<Degree>(v.value)){
+					//Only write to the distance if it was unevealuated (-1). This is done atomically
+					if(compareAndSwap(
+						&(distance[n.value]),
+						-1,
+						distance[v.value] + 1
+					)){
+						//Store the value for the next frontier
+						localNext.push_back(n);
+					}
 				}
 			}
 
-		//This next section is critical, as only a single thread can safely updated next at a time.
-		#pragma omp critical
+			int thread = omp_get_thread_num();
+			offsets[thread + 1] = localNext.size();
+		#pragma omp barrier
+		#pragma omp single
 			{
-				for(auto v : local_next){
-					next.push_back(v);
+				for(int i = 0; i != omp_get_num_threads(); ++i){
+					offsets[i + 1] += offsets[i];
 				}
+				next.resize(start + offsets[omp_get_num_threads()]);
 			}
+			std::copy(localNext.begin(), localNext.end(), next.begin() + start + offsets[thread]);
 		}
 	};
 
-	//Performs a parallelised breadth first search on the graph starting from the source
-	Array<int> breadthFirstSearch(const Graph& graph, Vertex source){
+	//A set of vertices, stored as one bit per vertex
+	struct Bitmap{
+		Array<uint64_t> words;
+
+		//Makes the set able to hold the vertices [0, order), and empties it
+		void reset(int order){
+			words.assign((order + 63) / 64, 0);
+		};
+
+		//Adds vertex v to the set. Not safe to call from multiple threads.
+		void set(int v){
+			words[v / 64] |= uint64_t(1) << (v % 64);
+		};
+
+		//Returns true if vertex v is in the set
+		bool test(int v) const{
+			return (words[v / 64] >> (v % 64)) & 1;
+		};
+	};
+
+	//Number of vertices, and the number of edges leaving them, added by a step
+	struct StepSize{
+		int vertices = 0;
+		long long edges = 0;
+	};
+
+	/*
+	* For every unevaluated vertex, checks if any of its neighbours are in the frontier and if so sets its
+	* distance. A vertex stops checking as soon as it finds one, which is where this beats a top down step
+	* when the frontier holds a large part of the graph.
+	* Each thread builds whole words of next, so no atomics are needed. This is parallelised using OpenMP,
+	* unless parallel is false.
+	*/
+	template<int Degree>
+	StepSize bottomUpStep(
+		const Graph& graph,
+		const Bitmap& frontier,
+		Bitmap& next,
+		Array<int>& distance,
+		int level,
+		bool parallel = true
+	){
+		int order = graph.order();
+		int wordCount = (int)next.words.size();
+		int vertices = 0;
+		long long edges = 0;
+	#pragma omp parallel for schedule(dynamic, 16) reduction(+:vertices, edges) if(parallel)
+		for(int w = 0; w < wordCount; ++w){
+			uint64_t word = 0;
+			int end = std::min(order, (w + 1) * 64);
+			for(int v = w * 64; v < end; ++v){
+				if(distance[v] != -1){ continue; }
+				for(auto n : graph.neighbours<Degree>(v)){
+					if(frontier.test(n.value)){
+						distance[v] = level;
+						word |= uint64_t(1) << (v % 64);
+						++vertices;
+						edges += graph.degree<Degree>(v);
+						break;
+					}
+				}
+			}
+			next.words[w] = word;
+		}
+		return StepSize{vertices, edges};
+	};
+
+	//How breadthFirstSearch chooses the direction of each step
+	enum class BFSMode{
+		TopDown, //Always expand outwards from the frontier
+		DirectionOptimizing, //Search bottom up on the levels where the frontier is large
+	};
+
+	/*
+	* Tuning of the switch between directions, from Beamer et al. "Direction-Optimizing Breadth-First Search".
+	* Go bottom up once the frontier has more than 1/alpha of the unchecked edges, and top down again once
+	* it holds fewer than 1/beta of the vertices.
+	*/
+	constexpr long long bfsAlpha = 14;
+	constexpr long long bfsBeta = 24;
+
+	//Scratch space for a search, which can be kept between searches so they don't allocate
+	struct BFSBuffers{
 		//The array of values to check this iteration
-		Array<Vertex> frontier{source};
+		Array<Vertex> frontier;
 		//The array of values to check next iteration
-		Array<Vertex> next{};
-		auto distance = Array<int>(graph.v.size(), -1); //-1 means unevaluated
+		Array<Vertex> next;
+		//The frontier as a bitmap, only used while searching bottom up
+		Bitmap frontierBits;
+		Bitmap nextBits;
+	};
+
+	/*
+	* Performs a breadth first search on the graph starting from the source, writing the distances into
+	* distance. Each step is parallelised using OpenMP, unless parallel is false, which lets separate
+	* threads each run their own searches. Every vertex must have Degree neighbours, unless Degree is 0.
+	*/
+	template<int Degree>
+	void breadthFirstSearch(
+		const Graph& graph,
+		Vertex source,
+		Array<int>& distance,
+		BFSBuffers& buffers,
+		BFSMode mode = BFSMode::TopDown,
+		bool parallel = true
+	){
+		auto& [frontier, next, frontierBits, nextBits] = buffers;
+		frontier.assign(1, source);
+		next.resize(0);
+		distance.assign(graph.order(), -1); //-1 means unevaluated
 		distance[source.value] = 0; //This is the intial vertex
-		while(frontier.size() != 0){
-			topDownStepPar(graph, frontier, next, distance);
-			//Update next to the frontier, and reset next
-			std::swap(frontier, next);
-			next.resize(0);
+		auto step = [&](){
+			if(parallel){
+				topDownStepPar<Degree>(graph, frontier, next, distance);
+			} else{
+				topDownStep<Degree>(graph, frontier, next, distance);
+			}
+		};
+		if(mode == BFSMode::TopDown){
+			while(frontier.size() != 0){
+				step();
+				//Update next to the frontier, and reset next
+				std::swap(frontier, next);
+				next.resize(0);
+			}
+			return;
+		}
+
+		bool bottomUp = false;
+		StepSize size{1, graph.degree<Degree>(source.value)};
+		//Edges leaving vertices that haven't been reached yet
+		long long unchecked = (long long)graph.adjacency.size() - size.edges;
+		for(int level = 1; size.vertices != 0; ++level){
+			if(!bottomUp && size.edges > unchecked / bfsAlpha){
+				//Switch to bottom up, moving the frontier into a bitmap
+				frontierBits.reset(graph.order());
+				nextBits.reset(graph.order());
+				for(auto v : frontier){ frontierBits.set(v.value); }
+				bottomUp = true;
+			} else if(bottomUp && size.vertices < graph.order() / bfsBeta){
+				//Switch back to top down, moving the frontier into a list
+				frontier.resize(0);
+				for(int v = 0; v != graph.order(); ++v){
+					if(frontierBits.test(v)){ frontier.push_back({v}); }
+				}
+				bottomUp = false;
+			}
+
+			if(bottomUp){
+				size = bottomUpStep<Degree>(graph, frontierBits, nextBits, distance, level, parallel);
+				std::swap(frontierBits, nextBits);
+			} else{
+				step();
+				std::swap(frontier, next);
+				next.resize(0);
+				size = StepSize{(int)frontier.size(), 0};
+				for(auto v : frontier){ size.edges += graph.degree<Degree>(v.value); }
+			}
+			unchecked -= size.edges;
 		}
+	};
+
+	//Performs a breadth first search as above, with the version built for the graph's degree if there is one
+	void breadthFirstSearch(
+		const Graph& graph,
+		Vertex source,
+		Array<int>& distance,
+		BFSBuffers& buffers,
+		BFSMode mode = BFSMode::TopDown,
+		bool parallel = true
+	){
+		withDegree(graph.fixedDegree, [&](auto degree){
+			breadthFirstSearch<degree()>(graph, source, distance, buffers, mode, parallel);
+		});
+	};
+
+	//Performs a parallelised breadth first search on the graph starting from the source
+	Array<int> breadthFirstSearch(const Graph& graph, Vertex source, BFSMode mode = BFSMode::TopDown){
+		Array<int> distance;
+		BFSBuffers buffers;
+		breadthFirstSearch(graph, source, distance, buffers, mode);
 		return distance;
 	};
 };
\ No newline at end of file
@@ -0,0 +1,181 @@
+#pragma once
+#include "./Graph.h"
+#include "./graphFile.h"
+#include "./core.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <thread>
+
+namespace APSP{
+	//Marks the start of a checkpoint file, and changes whenever the layout does
+	constexpr char checkpointMagic[8] = {'O', 'D', 'P', 'C', 'K', 'P', '0', '4'};
+
+	/*
+	* Everything a chain needs to carry on annealing where it left off. The distances, speculative copies
+	* and source ranges are all rebuilt from the graph, so only the edges are kept of it, under the labels
+	* the chain has given its vertices. The annealing keeps no best graph apart from its current one, as the
+	* best over every chain is only chosen at the end.
+	*/
+	struct Checkpoint{
+		Array<Edge> edges;
+		double T = 0;
+		int iters = 0;
+		double energy = 0;
+		//State of process 0's randomGenerator, which chooses the moves
+		string generator;
+		//State of the generator every process of the chain draws the acceptance thresholds from
+		string acceptance;
+		//State of the generator every process draws the temperature exchanges from
+		string exchanges;
+		//The temperature slots of every chain, and the exchanges made so far
+		Array<int> slot;
+		int attempts = 0;
+		int swaps = 0;
+		//1 if the energy is still being estimated from a sample of the sources, and the moves accepted so far in the sample's window
+		int sampling = 0;
+		int windowAccepted = 0;
+		//The first source of each process of the chain, with an extra entry for the end of the last, as they were last shared out
+		Array<int> starts;
+		//The label each vertex had in the input, if the graph has been reordered, otherwise empty
+		Array<int> original;
+	};
+
+	/*
+	* Lays the checkpoint out as bytes. The file is the magic, then each value in the order of the struct,
+	* with arrays and strings led by their length as a 64 bit integer. Values are stored as they are in
+	* memory, so a checkpoint can only be read on a machine of the same byte order.
+	*/
+	Array<char> serialise(const Checkpoint& state){
+		Array<char> bytes(checkpointMagic, checkpointMagic + sizeof(checkpointMagic));
+		auto put = [&](const void* data, size_t size){
+			bytes.insert(bytes.end(), (const char*)data, (const char*)data + size);
+		};
+		auto putArray = [&](const auto* data, size_t count){
+			int64_t length = count;
+			put(&length, sizeof(length));
+			put(data, count * sizeof(*data));
+		};
+		putArray(state.edges.data(), state.edges.size());
+		put(&state.T, sizeof(state.T));
+		put(&state.iters, sizeof(state.iters));
+		put(&state.energy, sizeof(state.energy));
+		putArray(state.generator.data(), state.generator.size());
+		putArray(state.acceptance.data(), state.acceptance.size());
+		putArray(state.exchanges.data(), state.exchanges.size());
+		putArray(state.slot.data(), state.slot.size());
+		put(&state.attempts, sizeof(state.attempts));
+		put(&state.swaps, sizeof(state.swaps));
+		put(&state.sampling, sizeof(state.sampling));
+		put(&state.windowAccepted, sizeof(state.windowAccepted));
+		putArray(state.starts.data(), state.starts.size());
+		putArray(state.original.data(), state.original.size());
+		return bytes;
+	};
+
+	//Reads a checkpoint laid out by serialise. Returns nothing if the bytes aren't a whole checkpoint.
+	std::optional<Checkpoint> deserialise(std::span<const char> bytes){
+		size_t at = 0;
+		auto get = [&](void* data, size_t size){
+			if(bytes.size() - at < size){ return false; }
+			std::memcpy(data, bytes.data() + at, size);
+			at += size;
+			return true;
+		};
+		auto getArray = [&](auto& array){
+			int64_t length;
+			if(!get(&length, sizeof(length)) || length < 0){ return false; }
+			if((uint64_t)length > (bytes.size() - at) / sizeof(array[0])){ return false; }
+			array.resize(length);
+			return get(array.data(), length * sizeof(array[0]));
+		};
+
+		char magic[sizeof(checkpointMagic)];
+		if(!get(magic, sizeof(magic)) || std::memcmp(magic, checkpointMagic, sizeof(magic)) != 0){ return std::nullopt; }
+		Checkpoint state{};
+		bool whole =
+			getArray(state.edges) &&
+			get(&state.T, sizeof(state.T)) &&
+			get(&state.iters, sizeof(state.iters)) &&
+			get(&state.energy, sizeof(state.energy)) &&
+			getArray(state.generator) &&
+			getArray(state.acceptance) &&
+			getArray(state.exchanges) &&
+			getArray(state.slot) &&
+			get(&state.attempts, sizeof(state.attempts)) &&
+			get(&state.swaps, sizeof(state.swaps)) &&
+			get(&state.sampling, sizeof(state.sampling)) &&
+			get(&state.windowAccepted, sizeof(state.windowAccepted)) &&
+			getArray(state.starts) &&
+			getArray(state.original);
+		if(!whole){ return std::nullopt; }
+		return state;
+	};
+
+	/*
+	* Saves checkpoints every few iterations. The state is copied when it is saved, and then written on a
+	* thread of its own, so the annealing carries on while the file is written. The checkpoint is written
+	* beside the file it replaces and moved over it once complete, so a run stopped part way through writing
+	* leaves the last checkpoint whole. The first checkpoint that can't be written is reported once it has
+	* finished, and the annealing carries on, as the run itself is unharmed.
+	*/
+	struct Checkpointer{
+		string path;
+		//Iterations between checkpoints, 0 for none
+		int interval = 0;
+		//True for the process that writes the checkpoints
+		bool writer = false;
+		//The checkpoint the run carries on from, if it was resumed
+		std::optional<Checkpoint> resumed;
+		std::thread writing;
+		//Set by the writing thread if the checkpoint couldn't be written or moved into place
+		std::atomic<bool> failed{false};
+		bool reported = false;
+
+		Checkpointer() = default;
+		Checkpointer(const Checkpointer&) = delete;
+		Checkpointer& operator=(const Checkpointer&) = delete;
+
+		//Returns true if a checkpoint should be saved after this many iterations
+		bool due(int iters) const{
+			return interval != 0 && iters % interval == 0;
+		};
+
+		//Starts writing the state, once the last checkpoint has finished
+		void save(Checkpoint state){
+			if(!writer){ return; }
+			finish();
+			writing = std::thread([this, state = std::move(state)]{
+				auto bytes = serialise(state);
+				auto partial = path + ".part";
+				{
+					std::ofstream out(partial, std::ios::binary | std::ios::trunc);
+					out.write(bytes.data(), bytes.size());
+					if(!out){
+						failed = true;
+						return;
+					}
+				}
+				if(std::rename(partial.c_str(), path.c_str()) != 0){ failed = true; }
+			});
+		};
+
+		//Waits for the checkpoint being written, and reports it if it couldn't be
+		void finish(){
+			if(writing.joinable()){ writing.join(); }
+			if(failed && !reported){
+				printf("Can't write checkpoint %s, so the run carries on without it\n", path.c_str());
+				reported = true;
+			}
+		};
+
+		~Checkpointer(){
+			finish();
+		};
+	};
+};
\ No newline at end of file
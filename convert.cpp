@@ -0,0 +1,30 @@
+//Converts graph files between the text format of "startVertex endVertex" lines, and the binary format of
+//graphFile.h. The format of the input is detected, and the output is binary if its path ends in ".bin".
+
+#include "./graphFile.h"
+
+#include <stdio.h>
+
+//To build: g++ ./convert.cpp -std=c++2a -Wall -Wextra -O3 -o ./convert
+//To run: ./convert ./smallGraphBad.txt ./smallGraphBad.bin
+int main(int argc, char** argv){
+	if(argc != 3){
+		printf("Usage: convert <input graph> <output graph>\n");
+		return -2;
+	}
+	string input = argv[1];
+	string output = argv[2];
+
+	auto edges = APSP::readGraph(input);
+	if(!edges){
+		printf("Can't read %s\n", input.c_str());
+		return -1;
+	}
+	bool binary = output.size() >= 4 && output.compare(output.size() - 4, 4, ".bin") == 0;
+	if(!APSP::writeGraph(output, *edges, binary)){
+		printf("Can't write %s\n", output.c_str());
+		return -1;
+	}
+	printf("Wrote %zu edges to %s\n", edges->size(), output.c_str());
+	return 0;
+};
\ No newline at end of file
@@ -0,0 +1,273 @@
+#pragma once
+#include "./core.h"
+#include "./Graph.h"
+#include "./edgeExchange.h"
+#include "./multiSourceBFS.h"
+
+#include <cstdint>
+#include <atomic>
+#include <cstring>
+#include <span>
+
+namespace APSP{
+	//Distance stored for a vertex the source can't reach
+	constexpr uint16_t unreachable = UINT16_MAX;
+
+	/*
+	* Keeps the distances from every source in a range to every vertex. After a move only the sources
+	* whose distances could have changed are searched again, and the update can be rolled back if the move
+	* is rejected.
+	* The distances are stored by vertex, with the sources side by side, so checking a vertex against
+	* every source reads one contiguous row, and a multi-source search writes each vertex's new distances
+	* close together.
+	*/
+	struct DistanceCache{
+		int startVertex;
+		int endVertex;
+		int order;
+		//Number of sources
+		int width;
+		//One row per vertex, holding the distance from every source
+		Array<uint16_t> distances;
+		//The sum and largest distance of each source
+		Array<DistanceSums> sources;
+		//Sum of the distances over every source
+		long long total = 0;
+		//Number of sources that can't reach every vertex
+		int disconnected = 0;
+		//True if the last update stopped early because the total passed its cutoff
+		bool exceeded = false;
+
+		//The sources searched again by the last update, with their distances and results from before it
+		Array<int> changed;
+		Array<uint16_t> savedDistances;
+		Array<DistanceSums> savedSources;
+
+		//Searches from every source in [startVertex, endVertex) to fill the cache
+		DistanceCache(const Graph& graph, int startVertex, int endVertex) :
+			startVertex(startVertex),
+			endVertex(endVertex),
+			order(graph.order()),
+			width(endVertex - startVertex),
+			distances(size_t(width) * order),
+			sources(width)
+		{
+			for(int s = startVertex; s != endVertex; ++s){
+				changed.push_back(s);
+			}
+			search(graph);
+			for(auto& sums : sources){
+				total += sums.total;
+				disconnected += !sums.connected;
+			}
+			changed.clear();
+		};
+
+		//Returns the distance from the source to vertex v
+		uint16_t& at(int v, int source){
+			return distances[size_t(v) * width + (source - startVertex)];
+		};
+		uint16_t at(int v, int source) const{
+			return distances[size_t(v) * width + (source - startVertex)];
+		};
+
+		/*
+		* Returns true if the source's distances could be changed by moves already applied to the graph.
+		* The distances stay the same as long as no new edge skips a level of the source's search, and every
+		* vertex that lost a neighbour one level closer to the source still has another one.
+		*/
+		bool affected(int source, std::span<const Move> moves, const Graph& graph) const{
+			for(auto& move : moves){
+				for(auto& e : {move.newA, move.newB}){
+					if(std::abs(at(e.first, source) - at(e.second, source)) >= 2){ return true; }
+				}
+			}
+			for(auto& move : moves){
+				if(removedParent(source, move, graph)){ return true; }
+			}
+			return false;
+		};
+
+		//Returns true if removing either of the move's old edges left a vertex with no way one level closer to the source
+		bool removedParent(int source, const Move& move, const Graph& graph) const{
+			for(auto& e : {move.oldA, move.oldB}){
+				if(std::abs(at(e.first, source) - at(e.second, source)) != 1){ continue; }
+				//The removed edge was a shortest path step into the further vertex
+				int v = at(e.first, source) > at(e.second, source) ? e.first : e.second;
+				bool hasParent = false;
+				for(auto n : graph.neighbours(v)){
+					if(at(n.value, source) == at(v, source) - 1){
+						hasParent = true;
+						break;
+					}
+				}
+				if(!hasParent){ return true; }
+			}
+			return false;
+		};
+
+		//Searches from every source in the batch together, writing each new distance into the cache
+		void searchBatch(
+			const Graph& graph,
+			std::span<const int> batch,
+			Array<Lanes>& visited,
+			Array<Lanes>& frontier,
+			Array<Lanes>& next
+		){
+			visited.resize(order);
+			frontier.resize(order);
+			next.resize(order);
+			//Offsets of the batch's sources within a row
+			std::array<int, laneWidth> column;
+			Lanes all{};
+			for(uint i = 0; i != batch.size(); ++i){
+				column[i] = batch[i] - startVertex;
+				all.set(i);
+				at(batch[i], batch[i]) = 0;
+			}
+
+			DistanceSums sums;
+			withDegree(graph.fixedDegree, [&](auto degree){
+				sums = multiSourceStep<degree()>(graph, batch, visited, frontier, next, [&](int v, const Lanes& found, int level){
+					auto row = distances.data() + size_t(v) * width;
+					found.forEach([&](int i){ row[column[i]] = level; });
+				});
+			});
+			//Every distance has been written unless a source couldn't reach a vertex
+			if(!sums.connected){
+				for(int v = 0; v != order; ++v){
+					auto row = distances.data() + size_t(v) * width;
+					all.without(visited[v]).forEach([&](int i){ row[column[i]] = unreachable; });
+				}
+			}
+
+			//The results are found from the finished distances, as a flat pass is cheaper than updating them per bit
+			std::array<long long, laneWidth> totals{};
+			std::array<int, laneWidth> diameters{};
+			for(int v = 0; v != order; ++v){
+				auto row = distances.data() + size_t(v) * width;
+				for(uint i = 0; i != batch.size(); ++i){
+					totals[i] += row[column[i]];
+					diameters[i] = std::max(diameters[i], (int)row[column[i]]);
+				}
+			}
+			for(uint i = 0; i != batch.size(); ++i){
+				bool connected = diameters[i] != unreachable;
+				sources[column[i]] = connected ? DistanceSums{totals[i], diameters[i], true} : DistanceSums{0, 0, false};
+			}
+		};
+
+		/*
+		* Searches again from the sources in changed, which are updated in parallel.
+		* base is the total of the sources that aren't being searched. If the cutoff is active the search
+		* stops as soon as it is passed, or a source can't reach every vertex, leaving the cache only fit to
+		* be rolled back.
+		*/
+		void search(const Graph& graph, long long base = 0, Cutoff cutoff = {}){
+			int batches = (changed.size() + laneWidth - 1) / laneWidth;
+			//Progress shared between threads, so any of them can stop the rest
+			std::atomic<long long> found{base};
+			std::atomic<int> searched{0};
+			std::atomic<bool> stop{false};
+		#pragma omp parallel
+			{
+				//Each thread keeps its own scratch space between searches
+				thread_local Array<Lanes> visited;
+				thread_local Array<Lanes> frontier;
+				thread_local Array<Lanes> next;
+			#pragma omp for schedule(dynamic, 1)
+				for(int b = 0; b < batches; ++b){
+					if(stop.load(std::memory_order_relaxed)){ continue; }
+					std::span<const int> batch(
+						changed.data() + b * laneWidth,
+						std::min<size_t>(laneWidth, changed.size() - b * laneWidth)
+					);
+					searchBatch(graph, batch, visited, frontier, next);
+					if(!cutoff.active()){ continue; }
+
+					long long batchTotal = 0;
+					bool connected = true;
+					for(auto s : batch){
+						batchTotal += sources[s - startVertex].total;
+						connected = connected && sources[s - startVertex].connected;
+					}
+					auto soFar = found += batchTotal;
+					auto done = searched += (int)batch.size();
+					if(!connected || cutoff.exceeded(soFar, (long long)changed.size() - done)){
+						stop = true;
+					}
+				}
+			}
+			exceeded = stop;
+		};
+
+		/*
+		* Brings the cache up to date with moves already applied to the graph. If the total passes the cutoff
+		* the update stops early, and must be rolled back.
+		*/
+		void update(const Graph& graph, std::span<const Move> moves, Cutoff cutoff = {}){
+			changed.clear();
+			for(int s = startVertex; s != endVertex; ++s){
+				if(affected(s, moves, graph)){ changed.push_back(s); }
+			}
+
+			//Keep the old distances so the update can be rolled back
+			auto count = changed.size();
+			savedDistances.resize(count * order);
+			savedSources.resize(count);
+			for(int v = 0; v != order; ++v){
+				for(uint i = 0; i != count; ++i){
+					savedDistances[v * count + i] = at(v, changed[i]);
+				}
+			}
+			for(uint i = 0; i != count; ++i){
+				auto& sums = sources[changed[i] - startVertex];
+				savedSources[i] = sums;
+				total -= sums.total;
+				disconnected -= !sums.connected;
+			}
+
+			search(graph, total, cutoff);
+
+			for(auto s : changed){
+				total += sources[s - startVertex].total;
+				disconnected += !sources[s - startVertex].connected;
+			}
+		};
+
+		//Keeps the last update
+		void commit(){
+			exceeded = false;
+			changed.clear();
+		};
+
+		//Restores the distances from before the last update
+		void rollback(){
+			exceeded = false;
+			auto count = changed.size();
+			for(int v = 0; v != order; ++v){
+				for(uint i = 0; i != count; ++i){
+					at(v, changed[i]) = savedDistances[v * count + i];
+				}
+			}
+			for(uint i = 0; i != count; ++i){
+				auto& sums = sources[changed[i] - startVertex];
+				total -= sums.total;
+				disconnected -= !sums.connected;
+				sums = savedSources[i];
+				total += sums.total;
+				disconnected += !sums.connected;
+			}
+			changed.clear();
+		};
+
+		//Returns the sum of the distances over every source in the range, and the largest distance
+		DistanceSums sums() const{
+			DistanceSums result{total, 0, disconnected == 0, exceeded};
+			for(auto& s : sources){
+				result.diameter = std::max(result.diameter, s.diameter);
+			}
+			return result;
+		};
+	};
+};
\ No newline at end of file
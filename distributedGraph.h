@@ -0,0 +1,441 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./multiSourceBFS.h"
+#include "./edgeExchange.h"
+#include "./graphFile.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <utility>
+
+namespace APSP{
+	//Returns the range [begin, end) of the total the part of parts takes, as evenly as possible
+	std::pair<long long, long long> share(long long total, int part, int parts){
+		return {total * part / parts, total * (part + 1) / parts};
+	};
+
+	/*
+	* A graph split between the processes of a communicator by vertex (1D partitioning). Each process holds
+	* the neighbour lists of its own block of vertices, and the edges whose first vertex is one of them,
+	* so no process needs memory for more than its own part of the graph. The number of edges each process
+	* holds is known to all of them, so moves can be drawn from every edge.
+	*/
+	struct DistributedGraph{
+		mpi::Comm::Comm comm;
+		int rank;
+		int size;
+		//Number of vertices in the whole graph
+		int n;
+		//Number of vertices owned by each process, except the last which may own fewer
+		int block;
+		//The edges whose first vertex this process owns, each in ascending order
+		Array<Edge> e;
+		//Number of edges held by each process
+		Array<int> counts;
+		//Index in adjacency where each owned vertex's neighbours start, with an extra entry for the end of the last
+		Array<int> offsets;
+		//The neighbours of every owned vertex, in vertex order
+		Array<Vertex> adjacency;
+
+		/*
+		* Builds this process's part of the graph from its share of the edges, which can be any of them. Each
+		* edge is sent on to the owners of its end points. Must be called from every process of comm.
+		*/
+		DistributedGraph(std::span<const Edge> edges, mpi::Comm::Comm comm) : comm(comm){
+			rank = mpi::Comm::rank(comm);
+			size = mpi::Comm::size(comm);
+			//Vertices are only defined by their index, so we size to the largest one seen by any process
+			n = 0;
+			for(auto edge : edges){
+				n = std::max(n, std::max(edge.first, edge.second) + 1);
+			}
+			mpi::allReduce(&n, 1, mpi::Op::Max, comm);
+			block = std::max(1, (n + size - 1) / size);
+
+			Array<Array<Edge>> outgoing(size);
+			for(auto edge : edges){
+				edge.sort();
+				outgoing[owner(edge.first)].push_back(edge);
+				if(owner(edge.second) != owner(edge.first)){
+					outgoing[owner(edge.second)].push_back(edge);
+				}
+			}
+			Array<Edge> received;
+			mpi::allToAll(outgoing, received, comm);
+			outgoing = {};
+
+			//Count the degree of each owned vertex, then turn the counts into starting offsets
+			int local = last() - first();
+			offsets.assign(local + 1, 0);
+			for(auto edge : received){
+				for(auto v : {edge.first, edge.second}){
+					if(owns(v)){ ++offsets[v - first() + 1]; }
+				}
+			}
+			for(int i = 0; i != local; ++i){
+				offsets[i + 1] += offsets[i];
+			}
+			adjacency.resize(offsets[local]);
+
+			//Fill each owned vertex's neighbours in the order the edges arrived
+			Array<int> filled(offsets.begin(), offsets.end() - 1);
+			for(auto edge : received){
+				if(owns(edge.first)){
+					adjacency[filled[edge.first - first()]++] = {edge.second};
+					e.push_back(edge);
+				}
+				if(owns(edge.second)){ adjacency[filled[edge.second - first()]++] = {edge.first}; }
+			}
+
+			counts.resize(size);
+			int held = (int)e.size();
+			mpi::allGather(&held, 1, counts.data(), comm);
+		};
+
+		//Returns the number of vertices
+		int order() const{
+			return n;
+		};
+
+		//Returns the number of edges held by every process
+		int edgeCount() const{
+			return std::accumulate(counts.begin(), counts.end(), 0);
+		};
+
+		//Returns the process holding the edge at this index of every process's edges in rank order, and its index there
+		std::pair<int, int> holder(int index) const{
+			int p = 0;
+			while(index >= counts[p]){
+				index -= counts[p];
+				++p;
+			}
+			return {p, index};
+		};
+
+		//Returns the first vertex owned by this process
+		int first() const{
+			return std::min(n, rank * block);
+		};
+
+		//Returns the vertex after the last owned by this process
+		int last() const{
+			return std::min(n, (rank + 1) * block);
+		};
+
+		//Returns the process owning vertex v
+		int owner(int v) const{
+			return v / block;
+		};
+
+		//Returns true if this process owns vertex v
+		bool owns(int v) const{
+			return v >= first() && v < last();
+		};
+
+		//Returns the neighbours of the owned vertex v
+		std::span<const Vertex> neighbours(int v) const{
+			return {adjacency.data() + offsets[v - first()], adjacency.data() + offsets[v - first() + 1]};
+		};
+
+		//Returns the neighbours of the owned vertex v so they can be modified
+		std::span<Vertex> neighbours(int v){
+			return {adjacency.data() + offsets[v - first()], adjacency.data() + offsets[v - first() + 1]};
+		};
+	};
+
+	/*
+	* Replaces the edges oldA and oldB with nA and nB. Only the neighbour lists of owned end points are
+	* changed, and each edge is held by the owner of its first vertex. Every process counts the edges that
+	* move, so it knows how many each holds. Must be given the same edges on every process.
+	*/
+	void rewire(Edge oldA, Edge oldB, Edge nA, Edge nB, DistributedGraph& graph){
+		for(auto old : {oldA, oldB}){
+			for(auto v : {old.first, old.second}){
+				if(!graph.owns(v)){ continue; }
+				//Each end point of the old edges is in exactly one of the new edges
+				auto& newEdge = (v == nA.first || v == nA.second) ? nA : nB;
+				Vertex newVal{v != newEdge.first ? newEdge.first : newEdge.second};
+				auto neighbours = graph.neighbours(v);
+				*std::find(neighbours.begin(), neighbours.end(), Vertex{v != old.first ? old.first : old.second}) = newVal;
+			}
+		}
+		for(auto old : {oldA, oldB}){
+			--graph.counts[graph.owner(old.first)];
+			if(!graph.owns(old.first)){ continue; }
+			*std::find(graph.e.begin(), graph.e.end(), old) = graph.e.back();
+			graph.e.pop_back();
+		}
+		for(auto edge : {nA, nB}){
+			++graph.counts[graph.owner(edge.first)];
+			if(graph.owns(edge.first)){ graph.e.push_back(edge); }
+		}
+	};
+
+	//Performs the exchange described by the move
+	void applyMove(const Move& move, DistributedGraph& graph){
+		rewire(move.oldA, move.oldB, move.newA, move.newB, graph);
+	};
+
+	//Undoes a move that was the last applied to the graph
+	void revertMove(const Move& move, DistributedGraph& graph){
+		rewire(move.newA, move.newB, move.oldA, move.oldB, graph);
+	};
+
+	/*
+	* Returns true if the exchange of edges a and b would duplicate an edge. The process owning the first
+	* vertex of each new edge checks its neighbours, and the answers are combined. Must be called from
+	* every process.
+	*/
+	bool isMultigraph(Edge a, Edge b, const DistributedGraph& graph, bool swapType){
+		auto [A, B] = edgeExchange(a, b, swapType);
+		int found = 0;
+		for(auto edge : {A, B}){
+			if(!graph.owns(edge.first)){ continue; }
+			auto n = graph.neighbours(edge.first);
+			found = found || std::find(n.begin(), n.end(), Vertex{edge.second}) != n.end();
+		}
+		mpi::allReduce(&found, 1, mpi::Op::Or, graph.comm);
+		return found;
+	};
+
+	/*
+	* Chooses a move that would augment the graph into a new valid graph with two edges changed. Process 0
+	* draws two of every process's edges, counted in rank order, and the processes holding them send them
+	* to the rest. Every process returns the same move. Must be called from every process.
+	*/
+	Move chooseMove(const DistributedGraph& graph){
+		//An edge drawn, and which of the two it is
+		struct Pick{
+			int which;
+			Edge edge;
+		};
+		Array<Array<Pick>> outgoing(graph.size);
+		Array<Pick> received;
+		for(;;){
+			int picks[3];
+			if(graph.rank == 0){
+				int total = graph.edgeCount();
+				picks[0] = randomGenerator.next<int>() % total;
+				picks[1] = randomGenerator.next<int>() % total;
+				picks[2] = randomGenerator.next<bool>(); //Choose a swapping method
+			}
+			mpi::broadcast(picks, 3, 0, graph.comm);
+			if(picks[0] == picks[1]){ continue; }
+
+			for(auto& o : outgoing){ o.clear(); }
+			for(int which : {0, 1}){
+				auto [p, index] = graph.holder(picks[which]);
+				if(p != graph.rank){ continue; }
+				for(auto& o : outgoing){ o.push_back({which, graph.e[index]}); }
+			}
+			mpi::allToAll(outgoing, received, graph.comm);
+			Edge edges[2];
+			for(auto& r : received){
+				edges[r.which] = r.edge;
+			}
+
+			//Choose again if the edges share a vertex, or the exchange would duplicate an edge
+			bool swapType = picks[2];
+			if(duplicatedVertex(edges[0], edges[1]) || isMultigraph(edges[0], edges[1], graph, swapType)){ continue; }
+			auto [nA, nB] = edgeExchange(edges[0], edges[1], swapType);
+			return Move{picks[0], picks[1], swapType, edges[0], edges[1], nA, nB};
+		}
+	};
+
+	/*
+	* Returns the checksum of the edges of every process of comm together, given the position of this
+	* process's first edge in the file. Each process hashes its own edges, and the hashes are gathered and
+	* added up, so no process waits on another's. Must be called from every process of comm.
+	*/
+	uint64_t sharedChecksum(std::span<const Edge> edges, int64_t first, mpi::Comm::Comm comm){
+		static_assert(sizeof(uint64_t) == sizeof(long long));
+		uint64_t hash = graphChecksum(edges, first);
+		Array<uint64_t> hashes(mpi::Comm::size(comm));
+		mpi::allGather((long long*)&hash, 1, (long long*)hashes.data(), comm);
+		uint64_t total = 0;
+		for(auto part : hashes){
+			total += part;
+		}
+		return total;
+	};
+
+	/*
+	* Reads this process's share of the edges of a binary graph file, opened by every process of file.comm,
+	* sharing them between the processes of comm. The file is checked whole by sharedChecksum, without any
+	* process reading all of it. Returns nothing on every process if the file is of another version, cut
+	* short or damaged. Must be called from every process of file.comm.
+	*/
+	std::optional<Array<Edge>> readEdgeShare(mpi::File& file, mpi::Comm::Comm comm){
+		auto [rank, size] = mpi::Comm::info(comm);
+		GraphHeader header{};
+		long long fileSize = file.size();
+		if(fileSize < (long long)sizeof(header)){ return std::nullopt; }
+		file.readAt(0, (char*)&header, sizeof(header));
+		if(std::memcmp(header.magic, graphMagic, sizeof(graphMagic)) != 0){ return std::nullopt; }
+		if(header.m < 0 || (uint64_t)header.m != (fileSize - sizeof(header)) / sizeof(Edge)){ return std::nullopt; }
+
+		auto [begin, end] = share(header.m, rank, size);
+		Array<Edge> edges(end - begin);
+		file.readAt(sizeof(header) + begin * sizeof(Edge), (char*)edges.data(), edges.size() * sizeof(Edge));
+		if(sharedChecksum(edges, begin, comm) != header.checksum){ return std::nullopt; }
+		return edges;
+	};
+
+	/*
+	* Saves the graph in either format of graphFile.h, with each process writing its own edges after those
+	* of the processes before it. A binary file's checksum is found by sharedChecksum, as it is when read.
+	* Returns false if it couldn't be written. Must be called from every process of the graph's communicator.
+	*/
+	bool writeDistributedGraph(const string& path, const DistributedGraph& graph, bool binary){
+		Array<char> bytes;
+		if(binary){
+			bytes.resize(graph.e.size() * sizeof(Edge));
+			std::memcpy(bytes.data(), graph.e.data(), bytes.size());
+		} else{
+			auto text = textGraph(graph.e);
+			bytes.assign(text.begin(), text.end());
+		}
+		long long length = (long long)bytes.size();
+		Array<long long> lengths(graph.size);
+		mpi::allGather(&length, 1, lengths.data(), graph.comm);
+		long long offset = binary ? (long long)sizeof(GraphHeader) : 0;
+		for(int p = 0; p != graph.rank; ++p){
+			offset += lengths[p];
+		}
+
+		GraphHeader header{};
+		if(binary){
+			uint64_t hash = sharedChecksum(graph.e, (offset - (long long)sizeof(GraphHeader)) / (long long)sizeof(Edge), graph.comm);
+
+			int degree = 0;
+			for(int v = graph.first(); v != graph.last(); ++v){
+				degree = std::max(degree, (int)graph.neighbours(v).size());
+			}
+			mpi::allReduce(&degree, 1, mpi::Op::Max, graph.comm);
+			std::memcpy(header.magic, graphMagic, sizeof(graphMagic));
+			header.n = graph.order();
+			header.degree = degree;
+			header.m = graph.edgeCount();
+			header.checksum = hash;
+		}
+
+		mpi::File file(path, graph.comm, true);
+		if(!file.isOpen()){ return false; }
+		int written = file.writeAt(offset, bytes.data(), length);
+		if(binary){
+			written = file.writeAt(0, (const char*)&header, graph.rank == 0 ? sizeof(header) : 0) && written;
+		}
+		mpi::allReduce(&written, 1, mpi::Op::And, graph.comm);
+		return written;
+	};
+
+	//Sources that have newly reached a vertex owned by another process
+	struct Reach{
+		int vertex;
+		Lanes sources;
+	};
+
+	/*
+	* Finds the sum of the distances from every source in [startVertex, endVertex) to every vertex. laneWidth
+	* sources are searched at a time as in multiSourceBFS, with each process stepping only its own vertices.
+	* Sources reaching another process's vertex are sent to its owner with an all to all exchange on every
+	* level. The search stops early if the graph is disconnected, or the total passes the cutoff.
+	* Must be called from every process, and every process is given the same result.
+	*/
+	DistanceSums distributedBFS(const DistributedGraph& graph, int startVertex, int endVertex, Cutoff cutoff = {}){
+		int first = graph.first();
+		int local = graph.last() - first;
+		Array<Lanes> visited(local);
+		Array<Lanes> frontier(local);
+		Array<Lanes> next(local);
+		Array<Array<Reach>> outgoing(graph.size);
+		Array<Reach> received;
+
+		DistanceSums result{};
+		for(int batch = startVertex; batch < endVertex; batch += laneWidth){
+			int count = std::min(laneWidth, endVertex - batch);
+			std::fill(visited.begin(), visited.end(), Lanes{});
+			std::fill(frontier.begin(), frontier.end(), Lanes{});
+			Lanes all{};
+			for(int i = 0; i != count; ++i){
+				all.set(i);
+				if(graph.owns(batch + i)){
+					visited[batch + i - first].set(i);
+					frontier[batch + i - first].set(i);
+				}
+			}
+
+			long long total = 0;
+			for(int level = 1;; ++level){
+				//Push the frontier's sources to every neighbour, sending those owned elsewhere to their owner
+				std::fill(next.begin(), next.end(), Lanes{});
+				for(auto& o : outgoing){ o.clear(); }
+				for(int u = 0; u != local; ++u){
+					if(!frontier[u].any()){ continue; }
+					for(auto n : graph.neighbours(first + u)){
+						if(graph.owns(n.value)){
+							next[n.value - first] |= frontier[u];
+						} else{
+							outgoing[graph.owner(n.value)].push_back({n.value, frontier[u]});
+						}
+					}
+				}
+				mpi::allToAll(outgoing, received, graph.comm);
+				for(auto& r : received){
+					next[r.vertex - first] |= r.sources;
+				}
+
+				//Only the sources that haven't been here before are new
+				int found = 0;
+				for(int v = 0; v != local; ++v){
+					next[v] = next[v].without(visited[v]);
+					if(next[v].any()){
+						visited[v] |= next[v];
+						total += (long long)level * next[v].count();
+						found = 1;
+					}
+				}
+				mpi::allReduce(&found, 1, mpi::Op::Or, graph.comm);
+				if(!found){ break; }
+				result.diameter = std::max(result.diameter, level);
+				std::swap(frontier, next);
+			}
+
+			//Every source must have reached every vertex
+			int connected = 1;
+			for(auto& v : visited){
+				if(!(v == all)){
+					connected = 0;
+					break;
+				}
+			}
+			mpi::allReduce(&connected, 1, mpi::Op::And, graph.comm);
+			mpi::allReduce(&total, 1, mpi::Op::Sum, graph.comm);
+			result.total += total;
+			//A disconnected graph has no ASPL, so there is no need to carry on
+			if(!connected){
+				result.connected = false;
+				break;
+			}
+			if(cutoff.exceeded(result.total, endVertex - batch - count)){
+				result.exceeded = true;
+				break;
+			}
+		}
+		return result;
+	};
+
+	//Finds the average shortest path length between all pairs of vertices, and the diameter. Must be called from every process.
+	auto distributedASPL(const DistributedGraph& graph, Cutoff cutoff = {}){
+		struct Result{ double aspl; int diameter; };
+		auto sums = distributedBFS(graph, 0, graph.order(), cutoff);
+		if(!sums.connected || sums.exceeded){ return Result{INFINITY, 0}; }
+		return Result{sums.total / double(graph.order() - 1) / graph.order(), sums.diameter};
+	};
+};
\ No newline at end of file
@@ -2,15 +2,21 @@
 #include "./core.h"
 #include "./Graph.h"
 
+#include <span>
+#include <tuple>
+
 #include "Random.h"
 static Random randomGenerator{getRandSeed()};
 
 namespace APSP{
+	//Returns true if the edges A and B share a vertex
+	bool duplicatedVertex(const Edge& A, const Edge& B){
+		return (A.first == B.first || A.first == B.second || A.second == B.first || A.second == B.second);
+	};
+
 	//Returns true if the edges a and b share a vertex
 	bool duplicatedVertex(int a, int b, const Graph& edges){
-		auto& A = edges.e[a];
-		auto& B = edges.e[b];
-		return (A.first == B.first || A.first == B.second || A.second == B.first || A.second == B.second);
+		return duplicatedVertex(edges.e[a], edges.e[b]);
 	};
 
 	//Given two edges will perform an exchange and return one of two chose valid swaps
@@ -34,52 +40,87 @@ namespace APSP{
 	void updateNeighbours(int v, int oldVal, const Edge& newEdge, Graph& graph){
 		//Find the vertex that isn't v
 		Vertex newVal{v != newEdge.first ? newEdge.first : newEdge.second};
-		//Iterate throught the neighbours list to replace the old neighbour with the new.
-		std::replace(graph.v[v].begin(), graph.v[v].end(), Vertex{oldVal}, newVal);
+		//Replace the old neighbour with the new. Only the first match is replaced, so a vertex that is briefly
+		//connected twice to the same neighbour part way through a sequence of exchanges keeps its degree.
+		auto neighbours = graph.neighbours(v);
+		*std::find(neighbours.begin(), neighbours.end(), Vertex{oldVal}) = newVal;
 	};
 
-	//Will augment the two edges by the chosen technique
-	void edgeExchange2opt(int a, int b, Graph& graph, bool swapType){
-		auto oA = graph.e[a];
-		auto oB = graph.e[b];
-		auto [nA, nB] = edgeExchange(oA, oB, swapType);
-		//We know that the first value of A stayed in A
-		updateNeighbours(oA.first, oA.second, nA, graph);
-		updateNeighbours(oA.second, oA.first, nB, graph);
-		//Determine where the first value of B was sent
-		if(oB.first == nB.first || oB.first == nB.second){
-			//It remaind in edge B
-			updateNeighbours(oB.first, oB.second, nB, graph);
-			updateNeighbours(oB.second, oB.first, nA, graph);
-		} else{
-			//It was moved to edge A
-			updateNeighbours(oB.first, oB.second, nA, graph);
-			updateNeighbours(oB.second, oB.first, nB, graph);
+	//Sets the edges at a and b to nA and nB, moving each end point of the old edges over to its new neighbour
+	void rewire(int a, int b, Edge nA, Edge nB, Graph& graph){
+		for(auto old : {graph.e[a], graph.e[b]}){
+			for(auto v : {old.first, old.second}){
+				//Each end point of the old edges is in exactly one of the new edges
+				auto& newEdge = (v == nA.first || v == nA.second) ? nA : nB;
+				updateNeighbours(v, v != old.first ? old.first : old.second, newEdge, graph);
+			}
 		}
 		graph.e[a] = nA;
 		graph.e[b] = nB;
 	};
 
-	//Assumes that the vertices making up each edge are sorted in ascending order
-	bool isMultigraph(int a, int b, const Graph& graph, bool swapType){
-		//A multigraph is when an edge is duplicated
-		auto [A, B] = edgeExchange(graph.e[a], graph.e[b], swapType);
+	//Will augment the two edges by the chosen technique
+	void edgeExchange2opt(int a, int b, Graph& graph, bool swapType){
+		auto [nA, nB] = edgeExchange(graph.e[a], graph.e[b], swapType);
+		rewire(a, b, nA, nB, graph);
+	};
 
-		for(auto& e : graph.e){
-			if(e == A or e == B){ return true; }
+	//A 2-opt exchange of the edges at indices A and B. The edges before and after are kept so it can be undone.
+	struct Move{
+		int A;
+		int B;
+		bool swapType;
+		Edge oldA;
+		Edge oldB;
+		Edge newA;
+		Edge newB;
+	};
+
+	//Builds the move that exchanges the edges a and b of the graph by the chosen technique
+	Move makeMove(int a, int b, bool swapType, const Graph& graph){
+		auto [nA, nB] = edgeExchange(graph.e[a], graph.e[b], swapType);
+		return Move{a, b, swapType, graph.e[a], graph.e[b], nA, nB};
+	};
+
+	//Performs the exchange described by the move
+	void applyMove(const Move& move, Graph& graph){
+		rewire(move.A, move.B, move.newA, move.newB, graph);
+	};
+
+	//Undoes a move that was the last applied to the graph, by exchanging the new edges back to the old ones
+	void revertMove(const Move& move, Graph& graph){
+		rewire(move.A, move.B, move.oldA, move.oldB, graph);
+	};
+
+	//Performs each of the moves in order
+	void applyMoves(std::span<const Move> moves, Graph& graph){
+		for(auto& move : moves){
+			applyMove(move, graph);
 		}
+	};
+
+	//Undoes moves that were the last applied to the graph, in reverse order
+	void revertMoves(std::span<const Move> moves, Graph& graph){
+		for(auto it = moves.rbegin(); it != moves.rend(); ++it){
+			revertMove(*it, graph);
+		}
+	};
 
-		return false;
+	//Returns true if the exchange would duplicate an edge. Only the neighbours of the new edges' end points are read.
+	bool isMultigraph(int a, int b, const Graph& graph, bool swapType){
+		//A multigraph is when an edge is duplicated
+		auto [A, B] = edgeExchange(graph.e[a], graph.e[b], swapType);
+		//The new edges share no vertices, and neither can be one of the edges they replace
+		return graph.hasEdge(A) || graph.hasEdge(B);
 	};
 
 	/*
-	* Augments the input graph into a new valid graph with two edges changed.
-	* The edges swapped and the type of swap are returned
+	* Chooses a move that would augment the input graph into a new valid graph with two edges changed.
+	* The graph itself is left unchanged.
 	* 
 	* This is an implementation of the pseudo code of figure 4 in the first paper.
 	*/
-	auto edgeExchange(Graph& graph){
-		struct Result{ int A; int B; bool swapType; };
+	Move chooseMove(const Graph& graph){
 		int A;
 		int B;
 		bool swapType = false;
@@ -93,7 +134,16 @@ namespace APSP{
 			} while(duplicatedVertex(A, B, graph)); //Choose again if the edges are incident on the same vertex
 			swapType = randomGenerator.next<bool>(); //Choose a swapping method
 		} while(isMultigraph(A, B, graph, swapType)); //Choose the two edges again if the swap would result in a multigraph
-		edgeExchange2opt(A, B, graph, swapType); //Perform the exchange
-		return Result{A, B, swapType};
+		return makeMove(A, B, swapType, graph);
+	};
+
+	/*
+	* Augments the input graph into a new valid graph with two edges changed.
+	* The move performed is returned, so it can be shared or reverted.
+	*/
+	Move edgeExchange(Graph& graph){
+		auto move = chooseMove(graph);
+		applyMove(move, graph); //Perform the exchange
+		return move;
 	};
 };
\ No newline at end of file
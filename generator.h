@@ -0,0 +1,194 @@
+#pragma once
+#include "./edgeExchange.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <climits>
+#include <optional>
+#include <utility>
+
+namespace APSP{
+	//Returns true if every vertex of the graph can be reached from vertex 0
+	bool isConnected(const Graph& graph){
+		Array<bool> seen(graph.order(), false);
+		Array<int> queue{0};
+		seen[0] = true;
+		for(size_t head = 0; head != queue.size(); ++head){
+			for(auto neighbour : graph.neighbours(queue[head])){
+				if(!seen[neighbour.value]){
+					seen[neighbour.value] = true;
+					queue.push_back(neighbour.value);
+				}
+			}
+		}
+		return (int)queue.size() == graph.order();
+	};
+
+	//Rounds of exchanges a random graph is given to become connected before it is given up on
+	constexpr int connectingRounds = 100;
+
+	/*
+	* Builds a random connected graph on n vertices where every vertex has the given degree. It starts as a
+	* ring, with each vertex joined to its degree / 2 nearest vertices on either side, and the vertex opposite
+	* when the degree is odd. The ring is then shuffled by random edge exchanges, the same moves the
+	* annealing makes, which keep every degree and never duplicate an edge, but can split the graph apart.
+	* A split graph is shuffled again until it is connected, which almost always takes one round.
+	* Returns nothing if no such graph exists, as n * degree must be even and the degree less than n. Below
+	* degree 3 the only connected graphs are a single edge or a single cycle, so only complete ones are built.
+	*/
+	std::optional<Graph> randomRegularGraph(int n, int degree, long long exchanges){
+		if(degree < 1 || degree >= n || (long long)n * degree % 2 != 0){ return std::nullopt; }
+		if(degree < 3 && degree != n - 1){ return std::nullopt; }
+		Array<Edge> edges;
+		for(int v = 0; v != n; ++v){
+			for(int k = 1; k <= degree / 2; ++k){
+				Edge edge{v, (v + k) % n};
+				edge.sort();
+				edges.push_back(edge);
+			}
+			//n is even when the degree is odd, so every vertex has one opposite
+			if(degree % 2 == 1 && v < n / 2){
+				edges.push_back({v, v + n / 2});
+			}
+		}
+
+		Graph graph{std::move(edges)};
+		//A complete graph has only one layout, and no exchange that keeps it simple
+		if(degree == n - 1){ return graph; }
+		for(int round = 0; round != connectingRounds; ++round){
+			for(long long i = 0; i != exchanges; ++i){
+				applyMove(chooseMove(graph), graph);
+			}
+			if(isConnected(graph)){ return graph; }
+		}
+		return std::nullopt;
+	};
+
+	//Candidate jumps tried for each jump of a circulant graph, when there are more than this to choose from
+	constexpr int circulantCandidates = 256;
+
+	/*
+	* Returns the diameter and total distance from vertex 0 of the circulant graph on n vertices joining
+	* each vertex to those the jumps away on either side. Every vertex of a circulant graph looks the same,
+	* so this is every vertex's. The diameter is INT_MAX if the graph isn't connected.
+	*/
+	std::pair<int, long long> circulantDistances(int n, std::span<const int> jumps, Array<int>& distance, Array<int>& queue){
+		distance.assign(n, -1);
+		queue.resize(n);
+		distance[0] = 0;
+		queue[0] = 0;
+		int tail = 1;
+		long long total = 0;
+		for(int head = 0; head != tail; ++head){
+			int v = queue[head];
+			total += distance[v];
+			for(int j : jumps){
+				for(int w : {(v + j) % n, (v - j + n) % n}){
+					if(distance[w] == -1){
+						distance[w] = distance[v] + 1;
+						queue[tail++] = w;
+					}
+				}
+			}
+		}
+		return {tail == n ? distance[queue[n - 1]] : INT_MAX, total};
+	};
+
+	/*
+	* Builds a circulant graph on n vertices where every vertex has the given degree: vertex v is joined to
+	* v + j and v - j for each of degree / 2 jumps j, and to the vertex opposite when the degree is odd.
+	* The jumps are chosen greedily, starting from 1 so the graph is connected, each adding the one that
+	* leaves the smallest diameter, then total distance. Up to circulantCandidates jumps are tried for each,
+	* drawn at random when there are more. The graph is symmetric under every rotation.
+	* Returns nothing if no such graph exists, as n * degree must be even and the degree less than n.
+	*/
+	std::optional<Graph> circulantGraph(int n, int degree){
+		if(degree < 1 || degree >= n || (long long)n * degree % 2 != 0){ return std::nullopt; }
+		//The jumps below n / 2, each of which gives every vertex two neighbours
+		int largest = (n - 1) / 2;
+		Array<int> jumps;
+		//The opposite vertex is one jump that gives only one
+		if(degree % 2 == 1){ jumps.push_back(n / 2); }
+		if(degree > 1){ jumps.push_back(1); }
+		Array<bool> used(largest + 1, false);
+		used[1] = true;
+
+		Array<int> candidates;
+		while((int)jumps.size() != (degree + 1) / 2){
+			candidates.clear();
+			int unused = largest - ((int)jumps.size() - degree % 2);
+			if(unused <= circulantCandidates){
+				for(int j = 2; j <= largest; ++j){
+					if(!used[j]){ candidates.push_back(j); }
+				}
+			} else{
+				while((int)candidates.size() != circulantCandidates){
+					int j = 2 + randomGenerator.next<int>() % (largest - 1);
+					if(!used[j]){ candidates.push_back(j); }
+				}
+			}
+
+			//Each candidate is tried on its own thread, and the lowest is taken, the first on a tie
+			Array<std::pair<int, long long>> found(candidates.size());
+		#pragma omp parallel
+			{
+				thread_local Array<int> distance;
+				thread_local Array<int> queue;
+				Array<int> trial = jumps;
+				trial.push_back(0);
+			#pragma omp for schedule(dynamic, 1)
+				for(int c = 0; c < (int)candidates.size(); ++c){
+					trial.back() = candidates[c];
+					found[c] = circulantDistances(n, trial, distance, queue);
+				}
+			}
+			int best = int(std::min_element(found.begin(), found.end()) - found.begin());
+			jumps.push_back(candidates[best]);
+			used[candidates[best]] = true;
+		}
+
+		Array<Edge> edges;
+		for(int j : jumps){
+			//The opposite jump reaches each pair of vertices from both ends
+			int starts = 2 * j == n ? n / 2 : n;
+			for(int v = 0; v != starts; ++v){
+				Edge edge{v, (v + j) % n};
+				edge.sort();
+				edges.push_back(edge);
+			}
+		}
+		return Graph{std::move(edges)};
+	};
+
+	//The starting graphs the solver can build for itself
+	enum class GraphKind{
+		None,
+		Random,
+		Circulant,
+	};
+
+	//Returns the path a generated graph is saved to when it isn't given one, named after its kind, order and degree
+	string generatedPath(GraphKind kind, int n, int degree){
+		//Appended a part at a time, as GCC warns of overlapping copies in the chain of operator+ at -O3
+		string path = kind == GraphKind::Circulant ? "circulant" : "random";
+		path += "-n";
+		path += std::to_string(n);
+		path += 'd';
+		path += std::to_string(degree);
+		path += ".txt";
+		return path;
+	};
+
+	//Builds the kind of graph on n vertices where every vertex has the given degree. Returns nothing if there is no such graph.
+	std::optional<Graph> generateGraph(GraphKind kind, int n, int degree){
+		switch(kind){
+			case GraphKind::Random:
+				return randomRegularGraph(n, degree, 10ll * n * degree);
+			case GraphKind::Circulant:
+				return circulantGraph(n, degree);
+			default:
+				return std::nullopt;
+		}
+	};
+};
\ No newline at end of file
@@ -0,0 +1,175 @@
+#pragma once
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+
+namespace APSP{
+	//Marks the start of a binary graph file, and changes whenever the layout does
+	constexpr char graphMagic[8] = {'O', 'D', 'P', 'G', 'R', 'P', '0', '2'};
+
+	/*
+	* The start of a binary graph file, which is followed by the m edges as pairs of 32 bit vertices.
+	* Values are stored as they are in memory, so a file can only be read on a machine of the same byte
+	* order. The checksum lets a file cut short or damaged in transfer be caught before it's annealed.
+	*/
+	struct GraphHeader{
+		char magic[8];
+		//Number of vertices, the largest degree, and the number of edges
+		int64_t n;
+		int64_t degree;
+		int64_t m;
+		//Sum of the hashes of each edge and its position, see graphChecksum
+		uint64_t checksum;
+	};
+
+	//Scrambles the bits of x, as the finaliser of splitmix64 does
+	constexpr uint64_t mixBits(uint64_t x){
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	};
+
+	/*
+	* Returns the checksum of the edges, given the position of the first in the file. Each edge is hashed
+	* with its position and the hashes are added, so the checksums of the parts of a file, worked out
+	* separately, add up to the checksum of the whole.
+	*/
+	uint64_t graphChecksum(std::span<const Edge> edges, int64_t first = 0){
+		static_assert(sizeof(Edge) == 2 * sizeof(int32_t));
+		uint64_t hash = 0;
+		for(size_t i = 0; i != edges.size(); ++i){
+			uint64_t edge = (uint64_t)(uint32_t)edges[i].first << 32 | (uint32_t)edges[i].second;
+			hash += mixBits(edge ^ mixBits(first + i));
+		}
+		return hash;
+	};
+
+	//Characters of graphMagic shared by every version of the layout
+	constexpr size_t graphFamily = 6;
+
+	//Returns true if the bytes start like a binary graph file of any version, so an older one is refused rather than read as text
+	bool isBinaryGraph(std::span<const char> bytes){
+		return bytes.size() >= sizeof(graphMagic) && std::memcmp(bytes.data(), graphMagic, graphFamily) == 0;
+	};
+
+	//Lays the edges out as a binary graph file
+	Array<char> binaryGraph(std::span<const Edge> edges){
+		GraphHeader header{};
+		std::memcpy(header.magic, graphMagic, sizeof(graphMagic));
+		//Vertices are only defined by their index, so the order is one more than the largest
+		Array<int> degrees;
+		for(auto edge : edges){
+			degrees.resize(std::max<size_t>(degrees.size(), std::max(edge.first, edge.second) + 1));
+			++degrees[edge.first];
+			++degrees[edge.second];
+		}
+		header.n = degrees.size();
+		header.degree = degrees.empty() ? 0 : *std::max_element(degrees.begin(), degrees.end());
+		header.m = edges.size();
+		header.checksum = graphChecksum(edges);
+
+		Array<char> bytes(sizeof(header) + edges.size_bytes());
+		std::memcpy(bytes.data(), &header, sizeof(header));
+		std::memcpy(bytes.data() + sizeof(header), edges.data(), edges.size_bytes());
+		return bytes;
+	};
+
+	//Reads the edges of a binary graph file. Returns nothing if the file is of another version, cut short, or doesn't match its checksum.
+	std::optional<Array<Edge>> parseBinaryGraph(std::span<const char> bytes){
+		GraphHeader header;
+		if(!isBinaryGraph(bytes) || bytes.size() < sizeof(header)){ return std::nullopt; }
+		std::memcpy(&header, bytes.data(), sizeof(header));
+		if(std::memcmp(header.magic, graphMagic, sizeof(graphMagic)) != 0){ return std::nullopt; }
+		if(header.m < 0 || (uint64_t)header.m != (bytes.size() - sizeof(header)) / sizeof(Edge)){ return std::nullopt; }
+		Array<Edge> edges(header.m);
+		std::memcpy(edges.data(), bytes.data() + sizeof(header), header.m * sizeof(Edge));
+		if(graphChecksum(edges) != header.checksum){ return std::nullopt; }
+		return edges;
+	};
+
+	/*
+	* Reads a text graph of the form "startVertex endVertex", with a new line between each edge. Any white
+	* space separates the vertices, and reading stops at the first thing that isn't a number.
+	*/
+	Array<Edge> parseTextGraph(std::span<const char> text){
+		Array<Edge> edges;
+		auto at = text.data();
+		auto end = text.data() + text.size();
+		auto next = [&](int& value){
+			while(at != end && (*at == ' ' || *at == '\n' || *at == '\r' || *at == '\t')){ ++at; }
+			auto [stop, error] = std::from_chars(at, end, value);
+			at = stop;
+			return error == std::errc{};
+		};
+		int a;
+		int b;
+		while(next(a) && next(b)){
+			edges.push_back({a, b});
+		}
+		return edges;
+	};
+
+	//Lays the edges out as a text graph, one edge per line
+	string textGraph(std::span<const Edge> edges){
+		string text;
+		//Two vertices of at most 11 characters each, a space and a new line
+		constexpr int digits = 11;
+		char line[2 * digits + 2];
+		for(auto edge : edges){
+			auto at = std::to_chars(line, line + digits, edge.first).ptr;
+			*at++ = ' ';
+			at = std::to_chars(at, at + digits, edge.second).ptr;
+			*at++ = '\n';
+			text.append(line, at);
+		}
+		return text;
+	};
+
+	//Reads the whole file. Returns nothing if it can't be opened.
+	std::optional<Array<char>> readFile(const string& path){
+		std::ifstream in(path, std::ios::binary);
+		if(!in){ return std::nullopt; }
+		in.seekg(0, std::ios::end);
+		Array<char> bytes(in.tellg());
+		in.seekg(0);
+		in.read(bytes.data(), bytes.size());
+		return bytes;
+	};
+
+	//Writes the bytes as the whole file. Returns false if it couldn't be written.
+	bool writeFile(const string& path, std::span<const char> bytes){
+		std::ofstream out(path, std::ios::binary | std::ios::trunc);
+		out.write(bytes.data(), bytes.size());
+		return (bool)out;
+	};
+
+	//Reads a graph file in either format. Returns nothing if it can't be read, or is a damaged binary file.
+	std::optional<Array<Edge>> readGraph(const string& path){
+		auto bytes = readFile(path);
+		if(!bytes){ return std::nullopt; }
+		if(isBinaryGraph(*bytes)){ return parseBinaryGraph(*bytes); }
+		return parseTextGraph(*bytes);
+	};
+
+	//Reads only the header of a binary graph file, without checking the edges. Returns nothing if the file can't be read or isn't binary.
+	std::optional<GraphHeader> readGraphHeader(const string& path){
+		std::ifstream in(path, std::ios::binary);
+		GraphHeader header;
+		if(!in.read((char*)&header, sizeof(header)) || !isBinaryGraph({header.magic, sizeof(header.magic)})){ return std::nullopt; }
+		return header;
+	};
+
+	//Writes a graph file in the binary format, or as text. Returns false if it couldn't be written.
+	bool writeGraph(const string& path, std::span<const Edge> edges, bool binary){
+		if(binary){ return writeFile(path, binaryGraph(edges)); }
+		auto text = textGraph(edges);
+		return writeFile(path, text);
+	};
+};
\ No newline at end of file
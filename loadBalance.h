@@ -0,0 +1,179 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace APSP{
+	//How much faster the slowest process must get before the sources are moved, as moving them has a cost
+	constexpr double rebalanceGain = 0.1;
+
+	/*
+	* Shares the sources between processes so they all finish at the same time. Process p searches speed[p]
+	* sources a second, and spends overhead[p] seconds on other work before it can join the reduction.
+	* Processes whose overhead alone is longer than the rest take are given no sources.
+	*/
+	Array<int> balancedCounts(int sources, const Array<double>& speed, const Array<double>& overhead){
+		int size = (int)speed.size();
+		Array<double> share(size, 0);
+		Array<bool> idle(size, false);
+		for(bool changed = true; changed;){
+			changed = false;
+			//The time every working process would finish at
+			double speeds = 0;
+			double work = sources;
+			for(int p = 0; p != size; ++p){
+				if(idle[p]){ continue; }
+				speeds += speed[p];
+				work += speed[p] * overhead[p];
+			}
+			double finish = work / speeds;
+			for(int p = 0; p != size; ++p){
+				if(idle[p]){ continue; }
+				share[p] = speed[p] * (finish - overhead[p]);
+				if(share[p] < 0){
+					share[p] = 0;
+					idle[p] = true;
+					changed = true;
+				}
+			}
+		}
+
+		//Round down, then give what is left to the largest remainders
+		Array<int> counts(size);
+		int given = 0;
+		for(int p = 0; p != size; ++p){
+			counts[p] = (int)std::floor(share[p]);
+			given += counts[p];
+		}
+		Array<int> order(size);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b){
+			return share[a] - counts[a] > share[b] - counts[b];
+		});
+		for(int i = 0; given < sources; ++i, ++given){
+			++counts[order[i % size]];
+		}
+		return counts;
+	};
+
+	/*
+	* The range of sources each process of a chain searches from. Every process starts with an equal share,
+	* with any left over going to the last processes, as process 0 also chooses the moves. Each process
+	* then times its searches, and every few iterations the sources are shared out again by how fast each
+	* process searched, and how long process 0 spent choosing moves, so nodes of different speeds are all
+	* kept busy. Time spent waiting on other processes isn't counted, as it would hide the slowest.
+	* There can be more processes than sources, leaving some with none.
+	*/
+	struct SourceBalance{
+		//The processes of the chain, and this process's rank among them
+		mpi::Comm::Comm comm = mpi::Comm::Comm::World;
+		int rank = 0;
+		int size = 1;
+		//The first source of each process, with an extra entry for the end of the last
+		Array<int> starts;
+		//Measured since the last rebalance: the time spent searching and choosing moves, the number of
+		//sources searched, and the iterations taken
+		double searchTime = 0;
+		double otherTime = 0;
+		long long searched = 0;
+		int iterations = 0;
+
+		//Returns the first source of this process
+		int start() const{
+			return starts[rank];
+		};
+
+		//Returns the source after the last of this process
+		int end() const{
+			return starts[rank + 1];
+		};
+
+		//Sets the ranges from the number of sources given to each process
+		void assign(const Array<int>& counts){
+			starts.assign(size + 1, 0);
+			for(int p = 0; p != size; ++p){
+				starts[p + 1] = starts[p] + counts[p];
+			}
+		};
+
+		//Adds the time of one iteration, split into the time searching count of this process's sources and choosing moves
+		void record(double search, double other, long long count){
+			searchTime += search;
+			otherTime += other;
+			searched += count;
+			++iterations;
+		};
+
+		//Adds the time of one iteration that searched every one of this process's sources
+		void record(double search, double other){
+			record(search, other, end() - start());
+		};
+
+		/*
+		* Shares the sources out again from the times recorded, if that would make the slowest process
+		* noticeably faster. Every process is given every measurement and makes the same choice.
+		* Returns true if the ranges changed. Must be called from every process of the chain.
+		*/
+		bool rebalance(){
+			double measured[3] = {searchTime, otherTime, (double)searched};
+			Array<double> all(3 * size);
+			mpi::allGather(measured, 3, all.data(), comm);
+			int rounds = iterations;
+			searchTime = 0;
+			otherTime = 0;
+			searched = 0;
+			iterations = 0;
+			if(rounds == 0){ return false; }
+
+			//Processes that searched nothing are assumed to be as fast as the average of the rest
+			Array<double> speed(size, 0);
+			Array<double> overhead(size);
+			double known = 0;
+			int timed = 0;
+			for(int p = 0; p != size; ++p){
+				overhead[p] = all[3 * p + 1] / rounds;
+				if(all[3 * p] > 0 && all[3 * p + 2] > 0){
+					speed[p] = all[3 * p + 2] / all[3 * p];
+					known += speed[p];
+					++timed;
+				}
+			}
+			if(timed == 0){ return false; }
+			for(auto& s : speed){
+				if(s == 0){ s = known / timed; }
+			}
+
+			//The time the slowest process takes per iteration with the given counts
+			auto slowest = [&](auto count){
+				double result = 0;
+				for(int p = 0; p != size; ++p){
+					result = std::max(result, count(p) / speed[p] + overhead[p]);
+				}
+				return result;
+			};
+			auto counts = balancedCounts(starts[size], speed, overhead);
+			double now = slowest([&](int p){ return starts[p + 1] - starts[p]; });
+			double balanced = slowest([&](int p){ return counts[p]; });
+			if(balanced > now * (1 - rebalanceGain)){ return false; }
+			assign(counts);
+			return true;
+		};
+	};
+
+	//Shares the sources evenly between the processes of the chain. Must be called from every process of the chain.
+	SourceBalance balanceSources(int sources, mpi::Comm::Comm comm){
+		SourceBalance balance{};
+		balance.comm = comm;
+		balance.rank = mpi::Comm::rank(comm);
+		balance.size = mpi::Comm::size(comm);
+		Array<int> counts(balance.size);
+		for(int p = 0; p != balance.size; ++p){
+			counts[p] = sources / balance.size + (p >= balance.size - sources % balance.size);
+		}
+		balance.assign(counts);
+		return balance;
+	};
+};
\ No newline at end of file
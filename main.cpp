@@ -11,8 +11,20 @@
 #include "./core.h"
 #include "./mpiWrapper.h"
 #include "./simulatedAnnealing.h"
+#include "./options.h"
+#include "./replicaExchange.h"
+#include "./sharedGraph.h"
+#include "./distributedGraph.h"
+#include "./checkpoint.h"
+#include "./graphFile.h"
+#include "./telemetry.h"
+#include "./generator.h"
+#include "./batch.h"
 
 #include <fstream>
+#include <optional>
+#include <span>
+#include <string>
 #include <stdio.h>
 #include <omp.h>
 
@@ -40,38 +52,36 @@ void initMPIEdge(){
 	MPI_Type_commit(&mpiEdge);
 };
 
+//Returns the path of a file named after the input, with its file type replaced by the extension
+std::string derivedPath(std::string path, const std::string& extension){
+	if(path.size() > 4){
+		//Only strip the file type if it had one
+		if(path[path.size() - 4] == '.'){
+			path.resize(path.size() - 4);
+		}
+	}
+	return path + extension;
+};
 
+//Returns the path the result is saved to, named after the input with its file type replaced by ".res.txt", or ".res.bin" for a binary graph
+std::string resultPath(const std::string& path, bool binary){
+	return derivedPath(path, binary ? ".res.bin" : ".res.txt");
+};
 
-//To build: mpicxx ./main.cpp -std=c++2a -Wall -Wextra -O3 -fopenmp -o ./main
-//To run: mpirun -np 2 ./main ./smallGraphBad.txt -t 2
-int main(int argc, char** argv){
-	mpi::init(argc, argv);
-	auto [rank, size] = mpi::Comm::info();
-	initMPIEdge();
+//Saves the edges to the result's path. Returns false if they couldn't be written.
+bool writeResult(const std::string& path, std::span<const APSP::Edge> edges, bool binary){
+	return APSP::writeGraph(resultPath(path, binary), edges, binary);
+};
 
-	//Number of threads per process
-	int threads = 1;
-	string path = "";
 
-	//Check for command line arguments
-	if(argc == 2){
-		path = string(argv[1]);
-	} else if(argc == 4){
-		//Check if thread count is specified. As we only support two inputs, we can check both orderings explicitly.
-		if(argv[1][0] == '-'){
-			threads = atoi(argv[2]);
-			path = string(argv[3]);
-		} else{
-			path = string(argv[1]);
-			threads = atoi(argv[3]);
-		}
-	} else{
-		//Only print error in process 0
-		if(rank == 0){
-			printf("Invalid arguments. \"<filepath>\" must be present and optionaly and \"-t threadCount\"\n");
-		}
-		return -2;
-	}
+
+/*
+* Anneals the graph the options give on the processes of comm, and saves the result beside it. Returns 0
+* if it was solved, or the negative code of what stopped it. Must be called from every process of comm.
+*/
+int solve(APSP::Options options, mpi::Comm::Comm comm){
+	auto [rank, size] = mpi::Comm::info(comm);
+	auto& path = options.path;
 
 	//A valid path must be given
 	if(path.size() <= 0){
@@ -81,85 +91,369 @@ int main(int argc, char** argv){
 		return -1;
 	}
 
-	//Set the number of threads per process
-	omp_set_num_threads(threads);
+	//A generated graph is saved to the path by process 0, then read from it like any other. A resumed
+	//run reads the one generated before, so it starts from the same graph.
+	if(options.generate != APSP::GraphKind::None && !options.resume){
+		int written = 0;
+		if(rank == 0){
+			if(auto generated = APSP::generateGraph(options.generate, options.order, options.degree)){
+				bool binaryPath = path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+				written = APSP::writeGraph(path, generated->e, binaryPath);
+				if(!written){
+					printf("Can't write %s\n", path.c_str());
+				}
+			} else{
+				printf("There is no graph on %d vertices of degree %d\n", options.order, options.degree);
+			}
+		}
+		mpi::broadcast(&written, 0, comm);
+		if(!written){
+			return -10;
+		}
+	}
+
+	//Every chain needs at least one process
+	if(options.replicas > size){
+		if(rank == 0){
+			printf("Can't run %d chains on %d processes\n", options.replicas, size);
+		}
+		return -4;
+	}
+	//Speculative candidates are each judged against the exact energy
+	if(options.sampleFraction && options.speculative != 1){
+		if(rank == 0){
+			printf("--sample can't be used with --speculate\n");
+		}
+		return -8;
+	}
+	//The rotations of a symmetric graph are defined by its labels
+	if(options.reorder && options.symmetry != 1){
+		if(rank == 0){
+			printf("--reorder can't be used with -g\n");
+		}
+		return -9;
+	}
+	//A distributed graph is annealed in place, which none of these work with
+	if(options.distributed && (options.symmetry != 1 || options.speculative != 1 || options.sharedGraph || options.checkpointInterval || options.resume || options.telemetryInterval || options.sampleFraction || options.reorder)){
+		if(rank == 0){
+			printf("--distributed can't be used with -g, --speculate, --shared, --checkpoint, --resume, --telemetry, --sample or --reorder\n");
+		}
+		return -5;
+	}
+	//Split the processes into chains, each of which shares out the sources between its own processes
+	auto replicas = APSP::splitReplicas(options.replicas, options.exchangeInterval, comm);
 
 	//Total number of edges. Calculated in process 0 and then distributs so arrays can be resized.
 	int edgeCount;
-	//Edges that represent the graph
+	//Edges that represent the graph, or this process's share of them for a distributed graph
 	Array<APSP::Edge> edges;
+	//True if the graph file is in the binary format of graphFile.h, which the result is then saved in too
+	bool binary = false;
+
+	//Every process opens the graph together. A binary graph is read by all of them at once with MPI-IO,
+	//and needs no parsing or sending on. For a distributed graph each process reads only its share.
+	{
+		mpi::File file(path, comm);
+		if(!file.isOpen()){
+			if(rank == 0){
+				printf("Can't read %s\n", path.c_str());
+			}
+			replicas.release();
+			return -1;
+		}
+		auto fileSize = file.size();
+		char magic[sizeof(APSP::graphMagic)] = {};
+		if(fileSize >= (long long)sizeof(magic)){
+			file.readAt(0, magic, sizeof(magic));
+		}
+		binary = APSP::isBinaryGraph(magic);
+		if(binary){
+			std::optional<Array<APSP::Edge>> read;
+			if(options.distributed){
+				read = APSP::readEdgeShare(file, replicas.comm);
+			} else{
+				Array<char> bytes(fileSize);
+				file.readAt(0, bytes.data(), fileSize);
+				read = APSP::parseBinaryGraph(bytes);
+			}
+			//Every process checked the same bytes, so they all agree on whether the file is whole
+			if(!read){
+				if(rank == 0){
+					printf("%s is cut short, damaged, or of another version\n", path.c_str());
+				}
+				replicas.release();
+				return -7;
+			}
+			edges = std::move(*read);
+		}
+	}
+
+	//A text graph is only loaded in process 0, then distributed to the other processes
+	if(!binary){
+		if(rank == 0){
+			//File is assumed to be of format: "startVertex endVertex", with a new line between each edge
+			edges = APSP::parseTextGraph(APSP::readFile(path).value_or(Array<char>{}));
+		}
+		if(options.distributed){
+			//Each process of a chain is sent only its share, as the binary format is read
+			Array<Array<APSP::Edge>> outgoing(size);
+			if(rank == 0){
+				for(int p = 0; p != size; ++p){
+					int first = replicas.firstRank(replicas.chainOf(p, size), size);
+					int chainSize = replicas.firstRank(replicas.chainOf(p, size) + 1, size) - first;
+					auto [begin, end] = APSP::share(edges.size(), p - first, chainSize);
+					outgoing[p].assign(edges.begin() + begin, edges.begin() + end);
+				}
+			}
+			mpi::allToAll(outgoing, edges, comm);
+		} else if(rank == 0){
+			//Edge count must be sent first so the dynamically allocated array can be resized
+			edgeCount = (int)edges.size();
+			mpi::broadcast(&edgeCount, 0, comm);
+			mpi::broadcast(edges.data(), edgeCount, mpiEdge, 0, comm);
+		} else{
+			mpi::broadcast(&edgeCount, 0, comm);
+			edges.resize(edgeCount);
+			mpi::broadcast(edges.data(), edgeCount, mpiEdge, 0, comm);
+		}
+	}
+
+	//A distributed graph is split by vertex between the processes of each chain, which all search every source together
+	if(options.distributed){
+		APSP::DistributedGraph graph{edges, replicas.comm};
+		edges = {};
+		if(options.replicas > 1){
+			printf("Process %d of chain %d holds vertices %d to %d.\n", rank, replicas.chain, graph.first(), graph.last() - 1);
+		} else{
+			printf("Process %d holds vertices %d to %d.\n", rank, graph.first(), graph.last() - 1);
+		}
+		auto originalASPL = APSP::distributedASPL(graph);
+
+		//Run simulated anneling. The best chain then measures its graph, and saves it with each process writing its own edges.
+		double energy = APSP::distributedAnnealing(graph, options, replicas);
+		int best = replicas.bestChain(energy);
+		double final[2] = {0, 0};
+		int written = 1;
+		if(replicas.chain == best){
+			auto finalASPL = APSP::distributedASPL(graph);
+			final[0] = finalASPL.aspl;
+			final[1] = finalASPL.diameter;
+			written = APSP::writeDistributedGraph(resultPath(path, binary), graph, binary);
+		}
+		mpi::broadcast(final, 2, replicas.firstRank(best, size), comm);
+		mpi::broadcast(&written, replicas.firstRank(best, size), comm);
+
+		if(rank == 0){
+			printf("The original ASPL was %f, and the diameter was %d.\n", originalASPL.aspl, originalASPL.diameter);
+			printf("Final minimum ASPL was %f, and the diameter of this graph was %d.\n", final[0], (int)final[1]);
+			if(options.replicas > 1){
+				printf("The chains swapped temperatures %d out of %d times.\n", replicas.swaps, replicas.attempts);
+			}
+			if(!written){
+				printf("Can't write %s\n", resultPath(path, binary).c_str());
+			}
+		}
+		replicas.release();
+		return written ? 0 : -13;
+	}
 
-	//Only load the edges of the graph in process 0, then distribute this to the other processes
+	//Keep a copy of the original to compare against at the end, only needed by process 0
+	std::optional<APSP::Graph> originalGraph;
 	if(rank == 0){
-		std::ifstream infile(path);
-		int a;
-		int b;
-		//File is assumed to be of format: "startVertex endVertex", with a new line between each edge
-		while(infile >> a >> b){
-			edges.push_back({a, b});
-		}
-
-		//Edge count must be sent first so the dynamically allocated array can be resized
-		edgeCount = (int)edges.size();
-		mpi::broadcast(&edgeCount, 0);
-		mpi::broadcast(edges.data(), edgeCount, mpiEdge, 0);
-	} else{
-		mpi::broadcast(&edgeCount, 0);
-		edges.resize(edgeCount);
-		mpi::broadcast(edges.data(), edgeCount, mpiEdge, 0);
+		originalGraph = APSP::Graph{edges};
+	}
+
+	//Each chain saves its state to its own checkpoint, from its first process
+	int chainRank = mpi::Comm::rank(replicas.comm);
+	APSP::Checkpointer checkpoints{};
+	checkpoints.path = derivedPath(path, options.replicas > 1 ? ".chain" + std::to_string(replicas.chain) + ".ckpt" : ".ckpt");
+	checkpoints.interval = options.checkpointInterval;
+	checkpoints.writer = chainRank == 0;
+
+	//Each chain logs to its own file too, which a resumed run adds to
+	APSP::Telemetry telemetry{};
+	telemetry.path = derivedPath(path, options.replicas > 1 ? ".chain" + std::to_string(replicas.chain) + ".telemetry.csv" : ".telemetry.csv");
+	telemetry.interval = options.telemetryInterval;
+	telemetry.writer = chainRank == 0;
+	telemetry.append = options.resume;
+	if(options.telemetryInterval && !APSP::telemetryEnabled && rank == 0){
+		printf("This solver was built without telemetry, so nothing will be logged. Build it with make telemetry.\n");
 	}
 
-	APSP::Graph graph{edges};
-	//Keep a copy of the original to compare against at the end
-	auto originalGraph = graph;
+	//A resumed chain carries on from the graph in its checkpoint. The first process of the chain reads it and sends it to the rest.
+	if(options.resume){
+		Array<char> bytes;
+		int length = 0;
+		if(chainRank == 0){
+			if(auto file = APSP::readFile(checkpoints.path)){
+				bytes = std::move(*file);
+				length = (int)bytes.size();
+			}
+		}
+		mpi::broadcast(&length, 0, replicas.comm);
+		bytes.resize(length);
+		mpi::broadcast(bytes.data(), length, MPI_BYTE, 0, replicas.comm);
+		checkpoints.resumed = APSP::deserialise(bytes);
+
+		//Every chain must be able to carry on, and must have been saved with the same chains
+		int valid = checkpoints.resumed && (int)checkpoints.resumed->slot.size() == options.replicas;
+		mpi::allReduce(&valid, 1, mpi::Op::And, comm);
+		if(!valid){
+			if(rank == 0){
+				printf("Can't resume from %s\n", checkpoints.path.c_str());
+			}
+			replicas.release();
+			return -6;
+		}
+		edges = checkpoints.resumed->edges;
+		if(chainRank == 0){
+			printf("Chain %d resumed at iteration %d.\n", replicas.chain, checkpoints.resumed->iters);
+		}
+	}
 
-	//Range of vertices for this process
-	int startVertex;
-	int endVertex;
+	//With a shared graph only the first process of the chain on each node builds it, and the rest read it in place
+	APSP::SharedGraph shared{};
+	if(options.sharedGraph){
+		shared = APSP::shareByNode(replicas.comm);
+	}
+	//The graph keeps its own copy of the edges, so the list read in is let go
+	APSP::Graph graph = shared.share(APSP::Graph{shared.writer() ? std::move(edges) : Array<APSP::Edge>{}});
+	edges = {};
 
-	//Calculate a range off vertics each program is reponsible for checking
-	//Gives each process an equal number of vertices, and any remaining to process 0
+	//The searches use the version built for the graph's degree, if every vertex has the same one and it is
+	//one of SpecialisedDegrees. The copies made while annealing keep the choice.
+	if(!options.specialise){
+		graph.fixedDegree = 0;
+	}
 	if(rank == 0){
-		int width = graph.v.size() / size;
-		int offset = graph.v.size() - width * (size - 1);
-		mpi::broadcast(&offset, 0);
-		mpi::broadcast(&width, 0);
-		startVertex = 0;
-		endVertex = offset;
-	} else{
-		int offset;
-		int width;
-		mpi::broadcast(&offset, 0);
-		mpi::broadcast(&width, 0);
-		startVertex = width * (rank - 1) + offset;
-		endVertex = startVertex + width;
+		if(APSP::isSpecialised(graph.fixedDegree)){
+			printf("Searching with the version built for degree %d.\n", graph.fixedDegree);
+		} else{
+			printf("Searching with the version for any degree.\n");
+		}
+	}
+
+	//With symmetry only one vertex from each rotation needs to be searched from
+	auto symmetry = APSP::findSymmetry(graph, options.symmetry);
+	if(!symmetry){
+		if(rank == 0){
+			printf("The graph isn't symmetric under %d rotations\n", options.symmetry);
+		}
+		shared.release();
+		replicas.release();
+		return -3;
 	}
+	int sources = graph.order() / options.symmetry;
 
-	printf("Process %d will check from %d to %d.\n", rank, startVertex, endVertex - 1);
+	//Share the sources between the processes of the chain. Process 0 gets no more than the rest, as it
+	//also chooses the moves, and the ranges are moved as the chain runs to keep every process busy.
+	auto balance = APSP::balanceSources(sources, replicas.comm);
+	int startVertex = balance.start();
+	int endVertex = balance.end();
+
+	if(startVertex == endVertex){
+		printf("Process %d has no sources to check yet.\n", rank);
+	} else if(options.replicas > 1){
+		printf("Process %d of chain %d will check from %d to %d.\n", rank, replicas.chain, startVertex, endVertex - 1);
+	} else{
+		printf("Process %d will check from %d to %d.\n", rank, startVertex, endVertex - 1);
+	}
 
 	//Run simulated anneling
-	auto finalGraph = APSP::simulatedAnnealing(graph, rank, size, startVertex, endVertex);
+	auto finalGraph = APSP::simulatedAnnealing(std::move(graph), balance, options, *symmetry, replicas, shared, checkpoints, telemetry).graph;
 
+	int written = 1;
 	if(rank == 0){
-		auto [origAspl, origDiam] = calculateASPL(originalGraph, 0, originalGraph.v.size());
+		auto [origAspl, origDiam] = calculateASPL(*originalGraph, 0, originalGraph->order());
 		printf("The original ASPL was %f, and the diameter was %d.\n", origAspl, origDiam);
-		auto [aspl, diam] = calculateASPL(finalGraph, 0, finalGraph.v.size());
+		auto [aspl, diam] = calculateASPL(finalGraph, 0, finalGraph.order());
 		printf("Final minimum ASPL was %f, and the diameter of this graph was %d.\n", aspl, diam);
+		if(options.replicas > 1){
+			printf("The chains swapped temperatures %d out of %d times.\n", replicas.swaps, replicas.attempts);
+		}
 
 		//Save to file with derived filename
-		auto outPath = path;
-		if(outPath.size() > 4){
-			//Only strip the file type if it had one
-			if(outPath[outPath.size() - 4] == '.'){
-				outPath.resize(outPath.size() - 4);
-			}
+		written = writeResult(path, finalGraph.e, binary);
+		if(!written){
+			printf("Can't write %s\n", resultPath(path, binary).c_str());
 		}
-		outPath += ".res.txt";
-		std::ofstream outfile(outPath);
-		for(auto e: finalGraph.e){
-			outfile << e.first << ' ' << e.second << '\n';
+	}
+	//Every process returns the same code, so a batch reports the graph as failed whichever process tells it
+	mpi::broadcast(&written, 0, comm);
+	//A batch solves more graphs on the same processes, so nothing split off for this one is kept
+	shared.release();
+	replicas.release();
+	return written ? 0 : -13;
+};
+
+//Solves every graph in the manifest, on groups of the processes as described in batch.h. Must be called from every process.
+int solveBatch(const APSP::Options& options){
+	int rank = mpi::Comm::rank();
+	//The manifest is only read in process 0, then sent to the other processes
+	Array<char> bytes;
+	int length = -1;
+	if(rank == 0){
+		if(auto file = APSP::readFile(options.batch)){
+			bytes = std::move(*file);
+			length = (int)bytes.size();
+		}
+	}
+	mpi::broadcast(&length, 0);
+	if(length == -1){
+		if(rank == 0){
+			printf("Can't read %s\n", options.batch.c_str());
+		}
+		return -1;
+	}
+	bytes.resize(length);
+	mpi::broadcast(bytes.data(), length, MPI_BYTE, 0);
+	auto instances = APSP::parseManifest(bytes);
+	if(!instances){
+		if(rank == 0){
+			printf("%s has a line that is neither a graph file nor random|circulant order degree, or two graphs with the same path\n", options.batch.c_str());
+		}
+		return -11;
+	}
+
+	double started = omp_get_wtime();
+	//Every chain of a graph needs a process of its own, however cheap the graph
+	int failed = APSP::runBatch(*instances, options.groupSize, options.replicas, [&](const APSP::Instance& instance, mpi::Comm::Comm comm){
+		//Every graph is solved with the options given for the batch
+		auto single = options;
+		single.path = instance.path;
+		single.generate = instance.generate;
+		single.order = instance.order;
+		single.degree = instance.degree;
+		return solve(single, comm);
+	});
+	if(rank == 0){
+		printf("Solved %d of %d graphs in %.1f seconds.\n", (int)instances->size() - failed, (int)instances->size(), omp_get_wtime() - started);
+	}
+	return failed == 0 ? 0 : -12;
+};
+
+//To build: mpicxx ./main.cpp -std=c++2a -Wall -Wextra -O3 -fopenmp -o ./main
+//To run: mpirun -np 2 ./main ./smallGraphBad.txt -t 2
+int main(int argc, char** argv){
+	mpi::init(argc, argv);
+	int rank = mpi::Comm::rank();
+	initMPIEdge();
+
+	APSP::Options options{};
+
+	//Check for command line arguments
+	if(!APSP::parseOptions(argc, argv, options)){
+		//Only print error in process 0
+		if(rank == 0){
+			printf("Invalid arguments. \"<filepath>\" must be present.\n%s", APSP::usage);
 		}
+		return -2;
 	}
+
+	//Set the number of threads per process
+	omp_set_num_threads(options.threads);
+
+	int code = options.batch.size() != 0 ? solveBatch(options) : solve(options, mpi::Comm::Comm::World);
 	mpi::finalise();
-	return 0;
+	return code;
 };
\ No newline at end of file
@@ -2,10 +2,24 @@
 #include <mpi.h>
 #include "./core.h"
 
+#include <algorithm>
+#include <climits>
+#include <span>
+
 namespace mpi{
 	//Not exhaustive, just covering the ones we've used
 	enum class Datatype: MPI_Datatype{
 		Int = MPI_INT,
+		LongLong = MPI_LONG_LONG,
+		Double = MPI_DOUBLE,
+	};
+
+	//Operations for combining values in a reduction. Also not exhaustive
+	enum class Op: MPI_Op{
+		Sum = MPI_SUM,
+		Max = MPI_MAX,
+		Or = MPI_LOR,
+		And = MPI_LAND,
 	};
 
 	//The errors funtions like MPI_Send can return. These should be returned in the future, but the wrapper prevents most of these already.
@@ -43,11 +57,55 @@ namespace mpi{
 			struct Info{ const int rank = 0; const int size = 0; };
 			return Info{rank(comm), size(comm)};
 		}
+
+		//Splits the processes into a separate communicator for each color, ranked in order of key
+		Comm split(int color, int key, const Comm comm = Comm::World){
+			MPI_Comm result;
+			MPI_Comm_split(underlying(comm), color, key, &result);
+			return static_cast<Comm>(result);
+		};
+
+		//Splits the processes into a separate communicator for each node, whose processes can share memory
+		Comm splitShared(int key, const Comm comm = Comm::World){
+			MPI_Comm result;
+			MPI_Comm_split_type(underlying(comm), MPI_COMM_TYPE_SHARED, key, MPI_INFO_NULL, &result);
+			return static_cast<Comm>(result);
+		};
+
+		/*
+		* Makes a communicator of the processes of comm with these ranks, ranked in the order given. Only the
+		* processes listed take part, so the rest can carry on with other work. Must be called from every
+		* process listed, with the same ranks.
+		*/
+		Comm create(std::span<const int> ranks, const Comm comm = Comm::World){
+			MPI_Group whole;
+			MPI_Group part;
+			MPI_Comm result;
+			MPI_Comm_group(underlying(comm), &whole);
+			MPI_Group_incl(whole, (int)ranks.size(), ranks.data(), &part);
+			MPI_Comm_create_group(underlying(comm), part, 0, &result);
+			MPI_Group_free(&part);
+			MPI_Group_free(&whole);
+			return static_cast<Comm>(result);
+		};
+
+		//Waits until every process has called this
+		void barrier(const Comm comm = Comm::World){
+			MPI_Barrier(underlying(comm));
+		};
+
+		//Frees a communicator made by split, splitShared or create. Must be called from every process of it, once they are done with it.
+		void free(const Comm comm){
+			MPI_Comm handle = underlying(comm);
+			MPI_Comm_free(&handle);
+		};
 	};
 
 	//Set of compile time functions that map types to their MPI indicators
 	template<typename T> constexpr Datatype typeToMPI();
 	template<> constexpr Datatype typeToMPI<int>(){ return Datatype::Int; };
+	template<> constexpr Datatype typeToMPI<long long>(){ return Datatype::LongLong; };
+	template<> constexpr Datatype typeToMPI<double>(){ return Datatype::Double; };
 
 	//Intialise the MPI execution environment
 	void init(int& argc, char**& argv){
@@ -85,6 +143,14 @@ namespace mpi{
 		receive(sink, 1, sender, comm);
 	};
 
+	//Receives these values from whichever process sends first, and returns its rank
+	template<typename T>
+	int receiveAny(T* sink, int count, Comm::Comm comm = Comm::Comm::World){
+		MPI_Status status;
+		MPI_Recv(sink, count, underlying(typeToMPI<T>()), MPI_ANY_SOURCE, 0, underlying(comm), &status);
+		return status.MPI_SOURCE;
+	};
+
 	//Send these values to all other processes
 	template<typename T>
 	void broadcast(T* sink, int count, MPI_Datatype mpiType, int sender, Comm::Comm comm = Comm::Comm::World){
@@ -102,4 +168,193 @@ namespace mpi{
 	void broadcast(T* sink, int sender, Comm::Comm comm = Comm::Comm::World){
 		broadcast(sink, 1, sender, comm);
 	};
+
+	/*
+	* A non-blocking operation that has been started. The values it reads and writes must be left alone
+	* until it has been waited on.
+	*/
+	struct Request{
+		MPI_Request request = MPI_REQUEST_NULL;
+
+		//Blocks until the operation is done
+		void wait(){
+			MPI_Wait(&request, MPI_STATUS_IGNORE);
+		};
+
+		//Returns true if the operation is done, without blocking
+		bool test(){
+			int done;
+			MPI_Test(&request, &done, MPI_STATUS_IGNORE);
+			return done;
+		};
+	};
+
+	//Starts sending these values to all other processes
+	template<typename T>
+	Request iBroadcast(T* sink, int count, int sender, Comm::Comm comm = Comm::Comm::World){
+		Request request{};
+		MPI_Ibcast(sink, count, underlying(typeToMPI<T>()), sender, underlying(comm), &request.request);
+		return request;
+	};
+
+	//Combines count values from every process with op, giving the result to every process. sink may be the same as source.
+	template<typename T>
+	void allReduce(const T* source, T* sink, int count, Op op, Comm::Comm comm = Comm::Comm::World){
+		MPI_Allreduce(
+			source == sink ? MPI_IN_PLACE : source, sink, count,
+			underlying(typeToMPI<T>()), underlying(op), underlying(comm)
+		);
+	};
+
+	//Combines these values from every process with op, in place
+	template<typename T>
+	void allReduce(T* values, int count, Op op, Comm::Comm comm = Comm::Comm::World){
+		allReduce((const T*)values, values, count, op, comm);
+	};
+
+	//Starts combining count values from every process with op. sink may be the same as source.
+	template<typename T>
+	Request iAllReduce(const T* source, T* sink, int count, Op op, Comm::Comm comm = Comm::Comm::World){
+		Request request{};
+		MPI_Iallreduce(
+			source == sink ? MPI_IN_PLACE : source, sink, count,
+			underlying(typeToMPI<T>()), underlying(op), underlying(comm), &request.request
+		);
+		return request;
+	};
+
+	//Gathers count values from every process into sink, in rank order, on every process
+	template<typename T>
+	void allGather(const T* source, int count, T* sink, Comm::Comm comm = Comm::Comm::World){
+		auto type = underlying(typeToMPI<T>());
+		MPI_Allgather(source, count, type, sink, count, type, underlying(comm));
+	};
+
+	/*
+	* Allocates count values in memory shared by every process of comm, which must all be on one node.
+	* Process 0 provides all of the memory, and every process is given a pointer to it.
+	*/
+	template<typename T>
+	T* allocateShared(long long count, MPI_Win& window, Comm::Comm comm){
+		T* base;
+		bool root = Comm::rank(comm) == 0;
+		MPI_Win_allocate_shared(root ? count * sizeof(T) : 0, sizeof(T), MPI_INFO_NULL, underlying(comm), &base, &window);
+		if(!root){
+			MPI_Aint size;
+			int unit;
+			MPI_Win_shared_query(window, 0, &size, &unit, &base);
+		}
+		return base;
+	};
+
+	//Frees the memory of a window made by allocateShared. Must be called from every process of its communicator.
+	void freeShared(MPI_Win& window){
+		MPI_Win_free(&window);
+	};
+
+	//Sends count values to every process, and receives count values from every process into sink, in rank order
+	template<typename T>
+	void allToAll(const T* source, int count, T* sink, Comm::Comm comm = Comm::Comm::World){
+		auto type = underlying(typeToMPI<T>());
+		MPI_Alltoall(source, count, type, sink, count, type, underlying(comm));
+	};
+
+	/*
+	* Sends outgoing[p] to each process p, and gathers the values sent to this process into received, in rank
+	* order. The values are sent as bytes, so any plain struct can be used.
+	*/
+	template<typename T>
+	void allToAll(const Array<Array<T>>& outgoing, Array<T>& received, Comm::Comm comm = Comm::Comm::World){
+		int size = Comm::size(comm);
+		Array<int> sendCounts(size);
+		Array<int> sendOffsets(size);
+		Array<int> receiveCounts(size);
+		Array<int> receiveOffsets(size);
+		//The values for every process are sent from one array
+		Array<T> sending;
+		for(int p = 0; p != size; ++p){
+			sendOffsets[p] = (int)(sending.size() * sizeof(T));
+			sendCounts[p] = (int)(outgoing[p].size() * sizeof(T));
+			sending.insert(sending.end(), outgoing[p].begin(), outgoing[p].end());
+		}
+		//Each process needs to know how much it will be sent before it can receive it
+		allToAll(sendCounts.data(), 1, receiveCounts.data(), comm);
+		int total = 0;
+		for(int p = 0; p != size; ++p){
+			receiveOffsets[p] = total;
+			total += receiveCounts[p];
+		}
+		received.resize(total / sizeof(T));
+		MPI_Alltoallv(
+			sending.data(), sendCounts.data(), sendOffsets.data(), MPI_BYTE,
+			received.data(), receiveCounts.data(), receiveOffsets.data(), MPI_BYTE, underlying(comm)
+		);
+	};
+
+	/*
+	* A file opened by every process of a communicator together, for reading or writing with MPI-IO. Reads
+	* and writes are collective, so the file system can serve every process from one pass over the file.
+	*/
+	struct File{
+		MPI_File file = MPI_FILE_NULL;
+		Comm::Comm comm;
+
+		//Opens the file for reading, or for writing over from the start. Must be called from every process of comm.
+		File(const string& path, Comm::Comm comm = Comm::Comm::World, bool write = false) : comm(comm){
+			int mode = write ? MPI_MODE_WRONLY | MPI_MODE_CREATE : MPI_MODE_RDONLY;
+			if(MPI_File_open(underlying(comm), path.c_str(), mode, MPI_INFO_NULL, &file) != MPI_SUCCESS){
+				file = MPI_FILE_NULL;
+			} else if(write){
+				//Nothing the file held before is left past the end of what is written
+				MPI_File_set_size(file, 0);
+			}
+		};
+
+		File(const File&) = delete;
+		File& operator=(const File&) = delete;
+
+		~File(){
+			if(file != MPI_FILE_NULL){ MPI_File_close(&file); }
+		};
+
+		//Returns true if the file was opened
+		bool isOpen() const{
+			return file != MPI_FILE_NULL;
+		};
+
+		//Returns the size of the file in bytes
+		long long size() const{
+			MPI_Offset size;
+			MPI_File_get_size(file, &size);
+			return size;
+		};
+
+		/*
+		* Reads count bytes from the offset into sink, where each process can read its own part of the file.
+		* Large reads are split, as MPI counts are ints, and every process takes part in as many reads as the
+		* largest needs. Returns false if the bytes couldn't be read. Must be called from every process.
+		*/
+		bool readAt(long long offset, char* sink, long long count){
+			bool read = true;
+			long long most = count;
+			allReduce(&most, 1, Op::Max, comm);
+			for(long long done = 0; done < most; done += INT_MAX){
+				int chunk = (int)std::clamp<long long>(count - done, 0, INT_MAX);
+				read = MPI_File_read_at_all(file, offset + done, sink + std::min(done, count), chunk, MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS && read;
+			}
+			return read;
+		};
+
+		//Writes count bytes from source at the offset, in the same way. Returns false if they couldn't be written. Must be called from every process.
+		bool writeAt(long long offset, const char* source, long long count){
+			bool written = true;
+			long long most = count;
+			allReduce(&most, 1, Op::Max, comm);
+			for(long long done = 0; done < most; done += INT_MAX){
+				int chunk = (int)std::clamp<long long>(count - done, 0, INT_MAX);
+				written = MPI_File_write_at_all(file, offset + done, source + std::min(done, count), chunk, MPI_BYTE, MPI_STATUS_IGNORE) == MPI_SUCCESS && written;
+			}
+			return written;
+		};
+	};
 };
\ No newline at end of file
@@ -0,0 +1,251 @@
+#pragma once
+#include "./core.h"
+#include "./Graph.h"
+#include "./bfs.h"
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <climits>
+#include <cstdint>
+#include <span>
+
+namespace APSP{
+	//Number of 64 bit words searched together. Wider vector registers let a single pass carry more sources.
+#if defined(__AVX512F__)
+	constexpr int laneWords = 8;
+#elif defined(__AVX2__)
+	constexpr int laneWords = 4;
+#else
+	constexpr int laneWords = 1;
+#endif
+
+	//Number of sources searched in a single pass
+	constexpr int laneWidth = 64 * laneWords;
+
+	//A set of sources, one bit per source. The loops are fixed length so the compiler can vectorise them.
+	struct Lanes{
+		std::array<uint64_t, laneWords> w{};
+
+		//Adds every source in other to this set
+		Lanes& operator|=(const Lanes& other){
+			for(int i = 0; i != laneWords; ++i){ w[i] |= other.w[i]; }
+			return *this;
+		};
+
+		//Returns the sources in this set that aren't in other
+		Lanes without(const Lanes& other) const{
+			Lanes result;
+			for(int i = 0; i != laneWords; ++i){ result.w[i] = w[i] & ~other.w[i]; }
+			return result;
+		};
+
+		//Returns true if any source is in the set
+		bool any() const{
+			uint64_t x = 0;
+			for(int i = 0; i != laneWords; ++i){ x |= w[i]; }
+			return x != 0;
+		};
+
+		//Returns the number of sources in the set
+		int count() const{
+			int c = 0;
+			for(int i = 0; i != laneWords; ++i){ c += std::popcount(w[i]); }
+			return c;
+		};
+
+		//Returns true if both sets hold the same sources
+		bool operator==(const Lanes& other) const{
+			return w == other.w;
+		};
+
+		//Calls f with the index of every source in the set
+		template<typename F>
+		void forEach(F&& f) const{
+			for(int i = 0; i != laneWords; ++i){
+				for(auto x = w[i]; x != 0; x &= x - 1){
+					f(i * 64 + std::countr_zero(x));
+				}
+			}
+		};
+
+		//Adds the i'th source to the set
+		void set(int i){
+			w[i / 64] |= uint64_t(1) << (i % 64);
+		};
+	};
+
+	//The sum of all distances from a range of sources, and the largest of those distances
+	struct DistanceSums{
+		long long total = 0;
+		int diameter = 0;
+		bool connected = true;
+		//True if the search stopped early because the total was going to pass its cutoff
+		bool exceeded = false;
+	};
+
+	/*
+	* Lets a search stop early once its total is known to be larger than is useful. Every source still to
+	* be searched is assumed to add at least perSource, so the search stops as soon as the total so far plus
+	* that bound passes the limit.
+	*/
+	struct Cutoff{
+		long long limit = LLONG_MAX;
+		long long perSource = 0;
+
+		//Returns true if a limit has been set
+		bool active() const{
+			return limit != LLONG_MAX;
+		};
+
+		//Returns true if the total can no longer finish at or below the limit
+		bool exceeded(long long total, long long remainingSources) const{
+			return active() && total + perSource * remainingSources > limit;
+		};
+	};
+
+	/*
+	* Returns the smallest possible sum of the distances from one vertex to the other order - 1 vertices,
+	* when no vertex has more than degree neighbours. This is the Moore bound: a vertex has at most degree
+	* vertices at distance 1, degree * (degree - 1) at distance 2, and so on.
+	*/
+	long long mooreBound(int order, int degree){
+		if(degree < 1){ return 0; }
+		long long total = 0;
+		long long remaining = order - 1;
+		long long level = degree;
+		for(int distance = 1; remaining > 0; ++distance){
+			auto count = std::min(remaining, level);
+			total += count * distance;
+			remaining -= count;
+			level = std::min<long long>(level * std::max(degree - 1, 1), order);
+		}
+		return total;
+	};
+
+	/*
+	* Searches from up to laneWidth sources at once. Each vertex holds a bitset of the sources that have
+	* reached it, so a level is one OR over the neighbours of every vertex. The new bits on a level are all
+	* at the same distance, so a popcount is all that is needed to add them to the total.
+	* onReach(v, sources, level) is called with the sources that first reach v on each level. Every vertex
+	* must have Degree neighbours, unless Degree is 0.
+	*/
+	template<int Degree, typename Reached>
+	DistanceSums multiSourceStep(
+		const Graph& graph,
+		std::span<const int> sources,
+		Array<Lanes>& visited,
+		Array<Lanes>& frontier,
+		Array<Lanes>& next,
+		Reached&& onReach
+	){
+		auto order = graph.order();
+		std::fill(visited.begin(), visited.end(), Lanes{});
+		std::fill(frontier.begin(), frontier.end(), Lanes{});
+		Lanes all{};
+		for(int i = 0; i != (int)sources.size(); ++i){
+			visited[sources[i]].set(i);
+			frontier[sources[i]].set(i);
+			all.set(i);
+		}
+
+		DistanceSums result{};
+		for(int level = 1;; ++level){
+			bool found = false;
+			for(int v = 0; v != order; ++v){
+				Lanes reached{};
+				for(auto n : graph.neighbours<Degree>(v)){
+					reached |= frontier[n.value];
+				}
+				//Only the sources that haven't been here before are new
+				next[v] = reached.without(visited[v]);
+				if(next[v].any()){
+					visited[v] |= next[v];
+					result.total += (long long)level * next[v].count();
+					onReach(v, next[v], level);
+					found = true;
+				}
+			}
+			if(!found){ break; }
+			result.diameter = level;
+			std::swap(frontier, next);
+		}
+
+		//Every source must have reached every vertex
+		for(auto& v : visited){
+			if(!(v == all)){
+				result.connected = false;
+				break;
+			}
+		}
+		return result;
+	};
+
+	/*
+	* Finds the sum of the distances from every source in [startVertex, endVertex) to every vertex, laneWidth
+	* sources at a time. The search stops early if the graph is disconnected, or the total passes the cutoff.
+	* Every vertex must have Degree neighbours, unless Degree is 0.
+	*/
+	template<int Degree>
+	DistanceSums multiSourceBFS(const Graph& graph, int startVertex, int endVertex, Cutoff cutoff = {}){
+		auto order = graph.order();
+		int batches = (endVertex - startVertex + laneWidth - 1) / laneWidth;
+
+		long long total = 0;
+		int diameter = 0;
+		bool connected = true;
+		//Progress shared between threads, so any of them can stop the rest
+		std::atomic<long long> found{0};
+		std::atomic<int> searched{0};
+		std::atomic<bool> stop{false};
+		std::atomic<bool> exceeded{false};
+	#pragma omp parallel reduction(+:total) reduction(max:diameter) reduction(&&:connected)
+		{
+			//Scratch space is kept by each thread, so only the first call on a graph of this size allocates
+			thread_local Array<Lanes> visited;
+			thread_local Array<Lanes> frontier;
+			thread_local Array<Lanes> next;
+			visited.resize(order);
+			frontier.resize(order);
+			next.resize(order);
+		#pragma omp for schedule(dynamic, 1)
+			for(int b = 0; b < batches; ++b){
+				if(stop.load(std::memory_order_relaxed)){ continue; }
+				std::array<int, laneWidth> sources;
+				int count = std::min(laneWidth, endVertex - startVertex - b * laneWidth);
+				for(int i = 0; i != count; ++i){
+					sources[i] = startVertex + b * laneWidth + i;
+				}
+				auto sums = multiSourceStep<Degree>(
+					graph, {sources.data(), (size_t)count}, visited, frontier, next,
+					[](int, const Lanes&, int){}
+				);
+				total += sums.total;
+				diameter = std::max(diameter, sums.diameter);
+				connected = connected && sums.connected;
+
+				//A disconnected graph has no ASPL, so there is no need to carry on
+				if(!sums.connected){
+					stop = true;
+				} else if(cutoff.active()){
+					auto soFar = found += sums.total;
+					auto done = searched += count;
+					if(cutoff.exceeded(soFar, endVertex - startVertex - done)){
+						exceeded = true;
+						stop = true;
+					}
+				}
+			}
+		}
+		return DistanceSums{total, diameter, connected, exceeded};
+	};
+
+	//Finds the sum of the distances as above, with the version built for the graph's degree if there is one
+	DistanceSums multiSourceBFS(const Graph& graph, int startVertex, int endVertex, Cutoff cutoff = {}){
+		DistanceSums sums;
+		withDegree(graph.fixedDegree, [&](auto degree){
+			sums = multiSourceBFS<degree()>(graph, startVertex, endVertex, cutoff);
+		});
+		return sums;
+	};
+};
\ No newline at end of file
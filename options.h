@@ -0,0 +1,263 @@
+#pragma once
+#include "./core.h"
+#include "./aspl.h"
+#include "./bfs.h"
+#include "./generator.h"
+
+#include <cstring>
+#include <stdlib.h>
+
+namespace APSP{
+	//Settings for a run of the solver, read from the command line
+	struct Options{
+		//Path to the file defining the graph
+		string path = "";
+		//Number of threads per process
+		int threads = 1;
+		//How the distances are found when the energy is fully recalculated
+		ASPLEngine engine = ASPLEngine::BitParallel;
+		//Direction of the searches made by the PerSource engine
+		BFSMode bfsMode = BFSMode::TopDown;
+		//Fold of rotational symmetry kept by the graph, 1 for none. See symmetry.h
+		int symmetry = 1;
+		//Only search again from the sources a move could have changed, see distanceCache.h
+		bool incremental = false;
+		//Largest distance cache a process will keep, in bytes. Above this the energy is fully recalculated.
+		long long cacheLimit = 1ll << 30;
+		//Number of independent annealing chains the processes are split between, see replicaExchange.h
+		int replicas = 1;
+		//Iterations between temperature exchanges of the chains
+		int exchangeInterval = 10;
+		//Number of candidate moves evaluated together each iteration, 1 for one at a time
+		int speculative = 1;
+		//Iterations between sharing the sources out again by how fast each process is, 0 to keep them fixed. See loadBalance.h
+		int balanceInterval = 50;
+		//Processes of a chain on the same node read one copy of the graph in shared memory, see sharedGraph.h
+		bool sharedGraph = false;
+		//Split the graph's vertices between the processes of a chain instead of copying it, see distributedGraph.h
+		bool distributed = false;
+		//Iterations between saving the state of each chain, 0 for never. See checkpoint.h
+		int checkpointInterval = 0;
+		//Carry on from the checkpoints saved by an earlier run
+		bool resume = false;
+		//Iterations between logging how each chain is going, 0 for never. Only built in with -DTELEMETRY, see telemetry.h
+		int telemetryInterval = 0;
+		//Search with the version built for the graph's degree when there is one, see withDegree in Graph.h
+		bool specialise = true;
+		//Share of the sources the energy is estimated from at the start, 0 to always find it exactly. See sampledEnergy.h
+		double sampleFraction = 0;
+		//Seed the samples of the sources are drawn from, so a run can be repeated
+		int sampleSeed = 1;
+		//Relabel the vertices for locality before annealing, and every so many iterations as it goes, 0 for only at the start. See reorder.h
+		bool reorder = false;
+		int reorderInterval = 0;
+		//Build the starting graph rather than reading it, on order vertices of the given degree. See generator.h
+		GraphKind generate = GraphKind::None;
+		int order = 0;
+		int degree = 0;
+		//Path to a manifest of graphs to solve one after another, instead of a single graph. See batch.h
+		string batch = "";
+		//Processes that solve the most costly graph of a batch together, with fewer for the rest by their cost
+		int groupSize = 1;
+	};
+
+	//Printed when the arguments aren't valid
+	const char* usage =
+		"Usage: solver <filepath> [options]\n"
+		"       solver --generate random|circulant order degree [filepath] [options]\n"
+		"       solver --batch manifest [options]\n"
+		"  -t threadCount                Number of OpenMP threads per process\n"
+		"  --aspl bitparallel|persource  Search many sources at once (default), or each source separately.\n"
+		"                                persource shares the sources between threads, or each search's\n"
+		"                                levels on large graphs with few sources. sourceparallel and\n"
+		"                                levelparallel choose one of these\n"
+		"  --bfs topdown|direction       Direction of each per source search. direction switches to\n"
+		"                                bottom up steps on the large levels\n"
+		"  -g folds                      Keep the graph symmetric under this many rotations, and only\n"
+		"                                search from one vertex of each rotation. The graph must\n"
+		"                                already be symmetric\n"
+		"  --incremental                 Cache distances and only search again from sources a move\n"
+		"                                could change\n"
+		"  --no-incremental              Recalculate every distance after each move (default)\n"
+		"  -r chains                     Split the processes into this many chains, each annealing its own\n"
+		"                                graph at a different temperature, which swap temperatures\n"
+		"                                periodically. Each chain splits its sources between its processes\n"
+		"  --exchange iterations         Iterations between temperature swaps of the chains (default 10)\n"
+		"  --speculate K                 Evaluate K candidate moves at once, one per thread, and take the\n"
+		"                                first that is accepted. Turns off --incremental\n"
+		"  --balance iterations          Iterations between sharing the sources out again by how fast\n"
+		"                                each process searched (default 50). 0 keeps them fixed\n"
+		"  --shared                      Keep one copy of the graph per node, in memory shared by the\n"
+		"                                processes of each chain on that node. Turns off --incremental\n"
+		"  --distributed                 Split the vertices of the graph between the processes of each\n"
+		"                                chain, which search every source together. For graphs too large\n"
+		"                                for one process. Can't be used with -g, --speculate or --shared\n"
+		"  --checkpoint iterations       Save the state of each chain this often, beside the graph file\n"
+		"  --resume                      Carry on from the checkpoints beside the graph file\n"
+		"  --telemetry iterations        Log the phase times, acceptance, temperature, ASPL and diameter\n"
+		"                                of each chain this often, beside the graph file. Needs a solver\n"
+		"                                built with make telemetry\n"
+		"  --generic                     Search with the version for any degree, rather than the one\n"
+		"                                built for the graph's degree\n"
+		"  --sample fraction             Estimate the energy from this share of the sources at the start,\n"
+		"                                growing as the temperature falls, until the moves become\n"
+		"                                selective and the exact energy is used. Can't be used with\n"
+		"                                --speculate\n"
+		"  --sample-seed seed            Seed the samples of the sources are drawn from (default 1)\n"
+		"  --reorder                     Relabel the vertices so neighbours are close together before\n"
+		"                                annealing. The result keeps the input's labels. Can't be used\n"
+		"                                with -g\n"
+		"  --reorder-interval iterations Relabel them again this often as the moves change the graph\n"
+		"  --generate random|circulant order degree\n"
+		"                                Start from a random graph, or a circulant one with its jumps\n"
+		"                                chosen greedily for the lowest diameter and ASPL, with order\n"
+		"                                vertices of this degree. It is saved to the file path, or\n"
+		"                                kind-nOdD.txt if none is given, and read from there by --resume\n"
+		"  --batch manifest              Solve every graph listed in the manifest, one per line as a file\n"
+		"                                path or as random|circulant order degree [filepath]. Process 0\n"
+		"                                hands them out, largest first, to groups of the other processes\n"
+		"  --group processes             Processes solving the most costly graph of the batch, with the\n"
+		"                                rest given fewer by their cost (default 1)\n";
+
+	/*
+	* Reads the command line into the options. Flags can be given in any order around the graph path.
+	* Returns false if the arguments aren't valid.
+	*/
+	bool parseOptions(int argc, char** argv, Options& options){
+		for(int i = 1; i < argc; ++i){
+			auto arg = argv[i];
+			//Every flag other than the on/off switches takes a value
+			auto value = [&](){ return i + 1 < argc ? argv[++i] : nullptr; };
+			if(strcmp(arg, "-t") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.threads = atoi(v);
+			} else if(strcmp(arg, "-g") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.symmetry = atoi(v);
+				if(options.symmetry < 1){ return false; }
+			} else if(strcmp(arg, "-r") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.replicas = atoi(v);
+				if(options.replicas < 1){ return false; }
+			} else if(strcmp(arg, "--exchange") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.exchangeInterval = atoi(v);
+				if(options.exchangeInterval < 1){ return false; }
+			} else if(strcmp(arg, "--speculate") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.speculative = atoi(v);
+				if(options.speculative < 1){ return false; }
+			} else if(strcmp(arg, "--balance") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.balanceInterval = atoi(v);
+				if(options.balanceInterval < 0){ return false; }
+			} else if(strcmp(arg, "--aspl") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				if(strcmp(v, "bitparallel") == 0){
+					options.engine = ASPLEngine::BitParallel;
+				} else if(strcmp(v, "persource") == 0){
+					options.engine = ASPLEngine::PerSource;
+				} else if(strcmp(v, "sourceparallel") == 0){
+					options.engine = ASPLEngine::SourceParallel;
+				} else if(strcmp(v, "levelparallel") == 0){
+					options.engine = ASPLEngine::LevelParallel;
+				} else{
+					return false;
+				}
+			} else if(strcmp(arg, "--bfs") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				if(strcmp(v, "topdown") == 0){
+					options.bfsMode = BFSMode::TopDown;
+				} else if(strcmp(v, "direction") == 0){
+					options.bfsMode = BFSMode::DirectionOptimizing;
+				} else{
+					return false;
+				}
+			} else if(strcmp(arg, "--incremental") == 0){
+				options.incremental = true;
+			} else if(strcmp(arg, "--no-incremental") == 0){
+				options.incremental = false;
+			} else if(strcmp(arg, "--shared") == 0){
+				options.sharedGraph = true;
+			} else if(strcmp(arg, "--distributed") == 0){
+				options.distributed = true;
+			} else if(strcmp(arg, "--checkpoint") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.checkpointInterval = atoi(v);
+				if(options.checkpointInterval < 0){ return false; }
+			} else if(strcmp(arg, "--resume") == 0){
+				options.resume = true;
+			} else if(strcmp(arg, "--generic") == 0){
+				options.specialise = false;
+			} else if(strcmp(arg, "--sample") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.sampleFraction = atof(v);
+				if(options.sampleFraction <= 0 || options.sampleFraction > 1){ return false; }
+			} else if(strcmp(arg, "--sample-seed") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.sampleSeed = atoi(v);
+			} else if(strcmp(arg, "--reorder") == 0){
+				options.reorder = true;
+			} else if(strcmp(arg, "--reorder-interval") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.reorder = true;
+				options.reorderInterval = atoi(v);
+				if(options.reorderInterval < 0){ return false; }
+			} else if(strcmp(arg, "--generate") == 0){
+				auto kind = value();
+				auto order = value();
+				auto degree = value();
+				if(!degree){ return false; }
+				if(strcmp(kind, "random") == 0){
+					options.generate = GraphKind::Random;
+				} else if(strcmp(kind, "circulant") == 0){
+					options.generate = GraphKind::Circulant;
+				} else{
+					return false;
+				}
+				options.order = atoi(order);
+				options.degree = atoi(degree);
+				if(options.order < 2 || options.degree < 1){ return false; }
+			} else if(strcmp(arg, "--batch") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.batch = string(v);
+			} else if(strcmp(arg, "--group") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.groupSize = atoi(v);
+				if(options.groupSize < 1){ return false; }
+			} else if(strcmp(arg, "--telemetry") == 0){
+				auto v = value();
+				if(!v){ return false; }
+				options.telemetryInterval = atoi(v);
+				if(options.telemetryInterval < 0){ return false; }
+			} else if(arg[0] == '-'){
+				return false;
+			} else{
+				//Only one graph can be given
+				if(options.path.size() != 0){ return false; }
+				options.path = string(arg);
+			}
+		}
+		//A batch takes its graphs from the manifest
+		if(options.batch.size() != 0 && (options.path.size() != 0 || options.generate != GraphKind::None)){ return false; }
+		//A generated graph is named after its kind, order and degree, unless given a path
+		if(options.generate != GraphKind::None && options.path.size() == 0){
+			options.path = generatedPath(options.generate, options.order, options.degree);
+		}
+		return true;
+	};
+};
\ No newline at end of file
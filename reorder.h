@@ -0,0 +1,138 @@
+#pragma once
+#include "./edgeExchange.h"
+#include "./sharedGraph.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <numeric>
+#include <span>
+
+namespace APSP{
+	/*
+	* Finds the reverse Cuthill-McKee order of the vertices. Each component is searched breadth first from
+	* its vertex of lowest degree, taking the neighbours of each vertex from lowest to highest degree, and
+	* the order found is then reversed. Neighbouring vertices end up close together, so a search touches
+	* nearby parts of its distance array rather than jumping across it.
+	* Returns the new label of each vertex.
+	*/
+	Array<int> reverseCuthillMcKee(const Graph& graph){
+		int order = graph.order();
+		//Ties are broken by label rather than the order of the neighbour lists, so the order only depends on the edges
+		auto byDegreeThenLabel = [&](int a, int b){
+			return graph.degree(a) != graph.degree(b) ? graph.degree(a) < graph.degree(b) : a < b;
+		};
+		//Vertices by degree, so each component starts from its lowest
+		Array<int> byDegree(order);
+		std::iota(byDegree.begin(), byDegree.end(), 0);
+		std::sort(byDegree.begin(), byDegree.end(), byDegreeThenLabel);
+
+		Array<int> visit;
+		visit.reserve(order);
+		Array<bool> seen(order, false);
+		Array<int> neighbours;
+		for(int start : byDegree){
+			if(seen[start]){ continue; }
+			seen[start] = true;
+			visit.push_back(start);
+			for(size_t i = visit.size() - 1; i != visit.size(); ++i){
+				neighbours.clear();
+				for(auto n : graph.neighbours(visit[i])){
+					if(!seen[n.value]){
+						seen[n.value] = true;
+						neighbours.push_back(n.value);
+					}
+				}
+				std::sort(neighbours.begin(), neighbours.end(), byDegreeThenLabel);
+				visit.insert(visit.end(), neighbours.begin(), neighbours.end());
+			}
+		}
+
+		Array<int> label(order);
+		for(int i = 0; i != order; ++i){
+			label[visit[i]] = order - 1 - i;
+		}
+		return label;
+	};
+
+	//Returns the edge with its vertices relabelled, in ascending order
+	Edge relabel(Edge edge, const Array<int>& label){
+		Edge result{label[edge.first], label[edge.second]};
+		result.sort();
+		return result;
+	};
+
+	/*
+	* Relabels the vertices of the graph in place, vertex v becoming label[v]. The edges keep their
+	* indices, so moves still refer to the same edges, and the neighbours of each vertex are kept in
+	* ascending order. Works on a view too, as the arrays stay the same size.
+	*/
+	void relabel(Graph& graph, const Array<int>& label){
+		for(auto& edge : graph.e){
+			edge = relabel(edge, label);
+		}
+		//Every vertex keeps its degree, so the new offsets are the degrees in the new order
+		int order = graph.order();
+		Array<int> degrees(order);
+		for(int v = 0; v != order; ++v){
+			degrees[label[v]] = graph.degree(v);
+		}
+		for(int v = 0; v != order; ++v){
+			graph.offsets[v + 1] = graph.offsets[v] + degrees[v];
+		}
+		Array<int> filled(graph.offsets.begin(), graph.offsets.end() - 1);
+		for(auto edge : graph.e){
+			graph.adjacency[filled[edge.first]++] = {edge.second};
+			graph.adjacency[filled[edge.second]++] = {edge.first};
+		}
+		for(int v = 0; v != order; ++v){
+			auto n = graph.neighbours(v);
+			std::sort(n.begin(), n.end(), [](Vertex a, Vertex b){ return a.value < b.value; });
+		}
+	};
+
+	//Relabels the edges the move holds, so it can still be applied or reverted after the graph is relabelled
+	void relabel(Move& move, const Array<int>& label){
+		move.oldA = relabel(move.oldA, label);
+		move.oldB = relabel(move.oldB, label);
+		move.newA = relabel(move.newA, label);
+		move.newB = relabel(move.newB, label);
+	};
+
+	/*
+	* Relabels the graph by its reverse Cuthill-McKee order, along with any moves made on it but not yet
+	* settled. original holds the label each vertex had in the input, and is kept up to date, starting
+	* from every vertex as itself if it is empty. Only the writer of a shared graph changes it. Must be
+	* called from every process of the node's chain.
+	*/
+	void reorder(Graph& graph, Array<int>& original, std::span<Move> moves, const SharedGraph& shared){
+		if(original.empty()){
+			original.resize(graph.order());
+			std::iota(original.begin(), original.end(), 0);
+		}
+		//Every process finds the same order, before the writer starts changing the graph
+		auto label = reverseCuthillMcKee(graph);
+		shared.sync();
+		if(shared.writer()){
+			relabel(graph, label);
+		}
+		shared.sync();
+		for(auto& move : moves){
+			relabel(move, label);
+		}
+		Array<int> previous = original;
+		for(int v = 0; v != graph.order(); ++v){
+			original[label[v]] = previous[v];
+		}
+	};
+
+	//Gives the vertices of a reordered graph back the labels they had in the input. Must be called from every process of the node's chain.
+	void restoreLabels(Graph& graph, const Array<int>& original, const SharedGraph& shared){
+		if(original.empty()){ return; }
+		shared.sync();
+		if(shared.writer()){
+			relabel(graph, original);
+		}
+		shared.sync();
+	};
+};
\ No newline at end of file
@@ -0,0 +1,163 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./edgeExchange.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <cmath>
+
+namespace APSP{
+	//Ratio between the temperatures of neighbouring chains. Closer temperatures swap more often, but cover less range
+	constexpr double temperatureRatio = 0.8;
+
+	/*
+	* Replica exchange, also called parallel tempering. The processes are split into chains, each of which
+	* runs its own annealing on its own copy of the graph, sharing the work of each energy calculation
+	* between the processes of the chain. Each chain holds a slot on a ladder of temperatures, and every
+	* few iterations chains on neighbouring slots may swap them. Only the temperatures move between
+	* chains, so an exchange costs one small gather rather than sending graphs.
+	* With a single chain this does nothing, and every process works on the one graph as before.
+	*/
+	struct Replicas{
+		//Number of chains, and the chain this process belongs to
+		int count = 1;
+		int chain = 0;
+		//Every process working on the graph, which the chains are split from, and the processes of this chain
+		mpi::Comm::Comm all = mpi::Comm::Comm::World;
+		mpi::Comm::Comm comm = mpi::Comm::Comm::World;
+		//Number of iterations between exchanges
+		int interval = 10;
+		//The temperature slot held by each chain, where slot 0 is the hottest
+		Array<int> slot;
+		//Exchanges tried and made, for reporting
+		int attempts = 0;
+		int swaps = 0;
+		//The generator the exchanges are decided by, seeded the same on every process. It is kept apart from
+		//randomGenerator so a checkpoint can save it at the exchange, whatever process 0 has drawn since.
+		Random generator{0};
+
+		//Returns the chain the process of this rank in all belongs to
+		int chainOf(int rank, int size) const{
+			return rank * count / size;
+		};
+
+		//Returns the rank in all of the first process in the chain
+		int firstRank(int c, int size) const{
+			return (c * size + count - 1) / count;
+		};
+
+		//Returns the factor this chain's temperature is scaled by
+		double scale() const{
+			return pow(temperatureRatio, slot[chain]);
+		};
+
+		//Gathers the energy of every chain, which every process of a chain shares, onto every process
+		Array<double> energies(double energy) const{
+			int size = mpi::Comm::size(all);
+			Array<double> gathered(size);
+			mpi::allGather(&energy, 1, gathered.data(), all);
+			Array<double> result(count);
+			for(int c = 0; c != count; ++c){
+				result[c] = gathered[firstRank(c, size)];
+			}
+			return result;
+		};
+
+		/*
+		* Offers swaps between neighbouring temperature slots, alternating between the even and odd pairs
+		* on each round. Chains at temperatures Ti and Tj with energies Ei and Ej swap with probability
+		* exp((Ei - Ej) * (1 / Ti - 1 / Tj)). Every process draws the same random values from generator, so
+		* they all make the same decisions. Must be called from every process.
+		*/
+		void exchange(double energy, double T, int round){
+			if(count == 1){ return; }
+			auto E = energies(energy);
+			Array<double> thresholds(count - 1);
+			for(auto& t : thresholds){ t = generator.nextProb(); }
+
+			//The chain holding each slot
+			Array<int> holder(count);
+			for(int c = 0; c != count; ++c){ holder[slot[c]] = c; }
+			for(int s = round % 2; s + 1 < count; s += 2){
+				int a = holder[s];
+				int b = holder[s + 1];
+				double Ta = T * pow(temperatureRatio, s);
+				double Tb = T * pow(temperatureRatio, s + 1);
+				++attempts;
+				if(exp((E[a] - E[b]) * (1 / Ta - 1 / Tb)) >= thresholds[s]){
+					std::swap(slot[a], slot[b]);
+					++swaps;
+				}
+			}
+		};
+
+		//Returns true on every process if any chain's value is true. Must be called from every process.
+		bool any(bool value) const{
+			if(count == 1){ return value; }
+			int found = value;
+			mpi::allReduce(&found, 1, mpi::Op::Or, all);
+			return found;
+		};
+
+		//Returns the chain with the lowest energy, on every process. Must be called from every process.
+		int bestChain(double energy) const{
+			if(count == 1){ return 0; }
+			auto E = energies(energy);
+			int b = 0;
+			for(int c = 1; c != count; ++c){
+				if(E[c] < E[b]){ b = c; }
+			}
+			return b;
+		};
+
+		//Returns the edges of the chain with the lowest energy, on every process
+		Array<Edge> bestEdges(std::span<const Edge> e, double energy) const{
+			Array<Edge> edges(e.begin(), e.end());
+			if(count == 1){ return edges; }
+			int b = bestChain(energy);
+			//Every chain exchanges the same edges, so the edge count and order of the graphs match
+			static_assert(sizeof(Edge) == 2 * sizeof(int));
+			mpi::broadcast((int*)edges.data(), 2 * (int)edges.size(), firstRank(b, mpi::Comm::size(all)), all);
+			return edges;
+		};
+
+		//Returns the graph with the lowest energy over every chain, on every process
+		Graph best(Graph graph, double energy) const{
+			if(count == 1){ return graph; }
+			return Graph{bestEdges(graph.e, energy)};
+		};
+
+		//Frees the communicator of the chain, once it is done with. Must be called from every process.
+		void release(){
+			if(count == 1){ return; }
+			mpi::Comm::free(comm);
+			comm = all;
+		};
+	};
+
+	/*
+	* Splits the processes of comm into chains of consecutive ranks, as evenly as possible. Must be called from
+	* every process of comm, and chains must be no more than the number of processes.
+	*/
+	Replicas splitReplicas(int chains, int interval, mpi::Comm::Comm comm = mpi::Comm::Comm::World){
+		auto [rank, size] = mpi::Comm::info(comm);
+		Replicas replicas{};
+		replicas.count = chains;
+		replicas.interval = interval;
+		replicas.all = comm;
+		replicas.chain = replicas.chainOf(rank, size);
+		replicas.comm = chains == 1 ? comm : mpi::Comm::split(replicas.chain, rank, comm);
+		for(int c = 0; c != chains; ++c){
+			replicas.slot.push_back(c);
+		}
+		if(chains != 1){
+			int seed;
+			if(rank == 0){
+				seed = randomGenerator.next<int>();
+			}
+			mpi::broadcast(&seed, 0, comm);
+			replicas.generator = Random{seed};
+		}
+		return replicas;
+	};
+};
\ No newline at end of file
@@ -0,0 +1,160 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./multiSourceBFS.h"
+#include "./options.h"
+#include "./Graph.h"
+#include "./core.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <span>
+
+namespace APSP{
+	//Iterations the same sample of sources is kept for, and over which the acceptance is measured
+	constexpr int sampleWindow = 20;
+	//Share of moves accepted below which they are selective enough to need the exact energy
+	constexpr double selectiveAcceptance = 0.5;
+
+	/*
+	* A stratified sample of the sources. The sources are cut into strata of near equal size, and one source
+	* is drawn from each, which stands for its whole stratum. The sources are in ascending order.
+	*/
+	struct SourceSample{
+		Array<int> sources;
+		//The size of each source's stratum
+		Array<int> weights;
+		//Sum over the strata of size * (size - 1), which scales the variance of the estimate
+		double spread = 0;
+
+		//Returns the index of the first sampled source at or after v
+		int find(int v) const{
+			return int(std::lower_bound(sources.begin(), sources.end(), v) - sources.begin());
+		};
+
+		//Returns the number of sampled sources in [startVertex, endVertex)
+		int countIn(int startVertex, int endVertex) const{
+			return find(endVertex) - find(startVertex);
+		};
+	};
+
+	/*
+	* Draws count of the sources in [0, sources), one from each stratum. The sample only depends on the
+	* seed, so every process of a chain draws the same one, and a run with the same seed the same ones.
+	*/
+	SourceSample drawSample(int sources, int count, int seed){
+		Random random{seed};
+		SourceSample sample{};
+		for(int k = 0; k != count; ++k){
+			int low = (int)((long long)k * sources / count);
+			int high = (int)((long long)(k + 1) * sources / count);
+			sample.sources.push_back(low + random.next<int>() % (high - low));
+			sample.weights.push_back(high - low);
+			sample.spread += double(high - low) * (high - low - 1);
+		}
+		return sample;
+	};
+
+	/*
+	* Returns the share of the sources to sample after this many of the n iterations. It grows from the
+	* fraction given at the start to every source at the end, by the same factor each iteration, as the
+	* temperature falls.
+	*/
+	double sampleFraction(double start, int iters, int n){
+		return std::pow(start, 1.0 - double(iters) / n);
+	};
+
+	/*
+	* Totals of the sampled sources' distances: weighted by the size of their strata, plain, and squared.
+	* Kept as three doubles side by side so they can be summed over the processes in one reduction.
+	*/
+	struct SampleSums{
+		double weighted = 0;
+		double total = 0;
+		double squares = 0;
+	};
+	static_assert(sizeof(SampleSums) == 3 * sizeof(double));
+
+	/*
+	* Searches from the sampled sources in [startVertex, endVertex), laneWidth at a time, finding each
+	* one's total distance. If a source can't reach every vertex the weighted total is infinite.
+	*/
+	SampleSums localSampleSums(const Graph& graph, const SourceSample& sample, int startVertex, int endVertex){
+		int first = sample.find(startVertex);
+		int count = sample.countIn(startVertex, endVertex);
+		std::span<const int> sources(sample.sources.data() + first, count);
+		std::span<const int> weights(sample.weights.data() + first, count);
+		int batches = ((int)sources.size() + laneWidth - 1) / laneWidth;
+		auto order = graph.order();
+
+		double weighted = 0;
+		double total = 0;
+		double squares = 0;
+		bool connected = true;
+	#pragma omp parallel reduction(+:weighted, total, squares) reduction(&&:connected)
+		{
+			thread_local Array<Lanes> visited;
+			thread_local Array<Lanes> frontier;
+			thread_local Array<Lanes> next;
+			visited.resize(order);
+			frontier.resize(order);
+			next.resize(order);
+		#pragma omp for schedule(dynamic, 1)
+			for(int b = 0; b < batches; ++b){
+				auto batch = sources.subspan(b * laneWidth, std::min<size_t>(laneWidth, sources.size() - b * laneWidth));
+				//The total distance of each source in the batch
+				std::array<long long, laneWidth> totals{};
+				DistanceSums sums;
+				withDegree(graph.fixedDegree, [&](auto degree){
+					sums = multiSourceStep<degree()>(graph, batch, visited, frontier, next, [&](int, const Lanes& found, int level){
+						found.forEach([&](int i){ totals[i] += level; });
+					});
+				});
+				connected = connected && sums.connected;
+				for(int i = 0; i != (int)batch.size(); ++i){
+					weighted += double(weights[b * laneWidth + i]) * totals[i];
+					total += totals[i];
+					squares += double(totals[i]) * totals[i];
+				}
+			}
+		}
+		return SampleSums{connected ? weighted : INFINITY, total, squares};
+	};
+
+	//An estimate of the energy from a sample of the sources, and the variance of that estimate
+	struct SampledEnergy{
+		double energy = 0;
+		double variance = 0;
+	};
+
+	/*
+	* Turns the sums over every process into the estimate of the energy. Each sampled total stands for its
+	* stratum, so the estimate is unbiased. The variance is that of sampling the sources at random, using
+	* the spread of the sampled totals, which stratifying can only lower.
+	*/
+	SampledEnergy sampledEnergy(const SampleSums& sums, const SourceSample& sample, int order, const Options& options){
+		double scale = options.symmetry / (double(order) * (order - 1));
+		double count = (double)sample.sources.size();
+		double variance = 0;
+		if(count > 1){
+			double spread = std::max(0.0, (sums.squares - sums.total * sums.total / count) / (count - 1));
+			variance = scale * scale * spread * sample.spread;
+		}
+		return SampledEnergy{scale * sums.weighted, variance};
+	};
+
+	//Estimates the energy from the sample. Distributed, must be called from each process of the chain
+	SampledEnergy sampledEnergy(
+		const Graph& graph,
+		const SourceSample& sample,
+		int startVertex,
+		int endVertex,
+		const Options& options,
+		mpi::Comm::Comm comm
+	){
+		auto sums = localSampleSums(graph, sample, startVertex, endVertex);
+		mpi::allReduce(&sums.weighted, 3, mpi::Op::Sum, comm);
+		return sampledEnergy(sums, sample, graph.order(), options);
+	};
+};
\ No newline at end of file
@@ -0,0 +1,79 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <span>
+
+namespace APSP{
+	/*
+	* Lets the processes of a chain that are on the same node read one copy of the graph in place, rather
+	* than each keeping their own. The graph lives in an MPI-3 shared memory window provided by the node's
+	* first process of the chain, which is the only one to change it, and the others wait at sync until
+	* its changes are done.
+	* When the graph isn't shared every process owns and changes its own copy, and sync does nothing.
+	*/
+	struct SharedGraph{
+		bool shared = false;
+		//The chain's processes on this node, and this process's rank among them
+		mpi::Comm::Comm comm = mpi::Comm::Comm::World;
+		int rank = 0;
+		//The window holding the graph's arrays
+		MPI_Win window = MPI_WIN_NULL;
+
+		//Returns true if this process makes the changes to its graph
+		bool writer() const{
+			return !shared || rank == 0;
+		};
+
+		//Waits until the writer has finished changing the graph. Must be called from every process of the node's chain.
+		void sync() const{
+			if(shared){ mpi::Comm::barrier(comm); }
+		};
+
+		/*
+		* Moves the graph into the node's shared memory, and returns a view of it. Only the writer needs to
+		* have built the graph, the others can pass an empty one. Must be called from every process of the
+		* node's chain.
+		*/
+		Graph share(Graph graph){
+			if(!shared){ return graph; }
+			//Only the writer has the graph, so the others are sent its size
+			int sizes[2] = {graph.order(), (int)graph.e.size()};
+			mpi::broadcast(sizes, 2, 0, comm);
+			auto [order, edges] = sizes;
+
+			//The edges, offsets and neighbours are stored one after the other, as ints
+			static_assert(sizeof(Edge) == 2 * sizeof(int) && sizeof(Vertex) == sizeof(int));
+			auto base = mpi::allocateShared<int>(2ll * edges + (order + 1) + 2ll * edges, window, comm);
+			std::span<Edge> e((Edge*)base, edges);
+			std::span<int> offsets(base + 2ll * edges, order + 1);
+			std::span<Vertex> adjacency((Vertex*)(base + 2ll * edges + order + 1), 2 * edges);
+			if(writer()){
+				std::copy(graph.e.begin(), graph.e.end(), e.begin());
+				std::copy(graph.offsets.begin(), graph.offsets.end(), offsets.begin());
+				std::copy(graph.adjacency.begin(), graph.adjacency.end(), adjacency.begin());
+			}
+			sync();
+			return Graph{e, offsets, adjacency};
+		};
+
+		//Frees the window and the node's communicator, once every view of the graph is done with. Must be called from every process of the node's chain.
+		void release(){
+			if(!shared){ return; }
+			mpi::freeShared(window);
+			mpi::Comm::free(comm);
+			shared = false;
+		};
+	};
+
+	//Groups the processes of the chain by node, so the processes on each node can share one graph
+	SharedGraph shareByNode(mpi::Comm::Comm chain){
+		SharedGraph shared{};
+		shared.shared = true;
+		shared.comm = mpi::Comm::splitShared(mpi::Comm::rank(chain), chain);
+		shared.rank = mpi::Comm::rank(shared.comm);
+		return shared;
+	};
+};
\ No newline at end of file
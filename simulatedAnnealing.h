@@ -1,57 +1,113 @@
 #pragma once
 #include "./edgeExchange.h"
 #include "./mpiWrapper.h"
-#include "./bfs.h"
+#include "./aspl.h"
+#include "./distanceCache.h"
+#include "./options.h"
+#include "./symmetry.h"
+#include "./replicaExchange.h"
+#include "./sharedGraph.h"
+#include "./distributedGraph.h"
+#include "./loadBalance.h"
+#include "./checkpoint.h"
+#include "./telemetry.h"
+#include "./sampledEnergy.h"
+#include "./reorder.h"
 #include "./Graph.h"
 #include "./core.h"
 
-#include <numeric>
+#include <cmath>
+#include <optional>
+#include <omp.h>
 
 namespace APSP{
-	//Checks if all distances are valid (none are -1)
-	bool isValid(const Array<int>& dist){
-		for(auto d : dist){ if(d == -1){ return false; } }
-		return true;
-	}
-
-	//Finds the average shortest path length between all pairs of vertices, as well as the diameter.
-	auto calculateASPL(const APSP::Graph& graph, int startVertex, int endVertex){
-		//Struct so we can return multiple values
-		struct Result{ double aspl; int diameter; };
-
-		//Perform a test on the first vertex
-		auto dists = APSP::breadthFirstSearch(graph, {startVertex});
-		//If the graph is disconnected then not all pairs have paths
-		if(!isValid(dists)){ return Result{INFINITY, 0}; }
-
-		//The average for a vertex is the sum of its distance to all other vertices, so we subtract 1
-		auto div = double(graph.v.size() - 1);
-
-		//Intial values for what we are trying to find
-		int diameter = *std::max_element(dists.begin(), dists.end());
-		double total = std::accumulate(dists.begin(), dists.end(), 0) / div;
-
-		//Add the average for a given vertex to all others to the total
-		for(uint i = startVertex + 1; i != (uint)endVertex; ++i){
-			dists = APSP::breadthFirstSearch(graph, {(int)i});
-			//Add average distance to total
-			total += std::accumulate(dists.begin(), dists.end(), 0) / div;
-			//Only update the diameter if it is greater than our current
-			int newDiameter = *std::max_element(dists.begin(), dists.end());
-			diameter = diameter < newDiameter ? newDiameter : diameter;
-		}
-		return Result{total / graph.v.size(), diameter};
+	/*
+	* Turns the largest energy a step can have and still be accepted into a cutoff on the total distance
+	* from this process's sources. Every other process's sources are assumed to be at their lower bound
+	* perSource, so a search passing the cutoff can't be accepted whatever the others find.
+	*/
+	Cutoff energyCutoff(int order, int localSources, long long perSource, const Options& options, double maxEnergy){
+		if(!std::isfinite(maxEnergy)){ return Cutoff{}; }
+		//The energy is the total over every source, scaled by g / (n * (n - 1))
+		double maxTotal = maxEnergy * order * (order - 1.0) / options.symmetry;
+		int otherSources = order / options.symmetry - localSources;
+		//A small margin keeps rounding from stopping a search that would only just have been accepted
+		double limit = maxTotal * (1 + 1e-9) + 1 - double(perSource) * otherSources;
+		if(limit >= 9e18){ return Cutoff{}; }
+		return Cutoff{(long long)std::floor(limit), perSource};
+	};
+
+	//Calculates this process's share of the energy, from the sources in [startVertex, endVertex)
+	double localEnergy(const Graph& graph, int startVertex, int endVertex, const Options& options, Cutoff cutoff = {}){
+		//With symmetry each source stands for g rotations of itself
+		return options.symmetry * calculateASPL(
+			graph, startVertex, endVertex, options.engine, options.bfsMode, cutoff
+		).aspl;
+	};
+
+	//Calculates this process's share of the energy from the cached distances
+	double localEnergy(const DistanceCache& cache, const Options& options){
+		auto sums = cache.sums();
+		return sums.connected && !sums.exceeded ? options.symmetry * (sums.total / double(cache.order - 1) / cache.order) : INFINITY;
+	};
+
+	//Calculates the energy, which is just the ASPL. Distributed, must be called from each process of the chain
+	double calculateEnergy(
+		const Graph& graph,
+		int startVertex,
+		int endVertex,
+		const Options& options,
+		mpi::Comm::Comm comm,
+		Cutoff cutoff = {}
+	){
+		double newEnergy = localEnergy(graph, startVertex, endVertex, options, cutoff);
+		double totalEnergy;
+		//Sum results and distrbute them back to all other processes
+		mpi::allReduce(&newEnergy, &totalEnergy, 1, mpi::Op::Sum, comm);
+		return totalEnergy;
 	};
 
-	//Calculates the energy, which is just the ASPL. Distributed, must be called from each process
-	double calculateEnergy(const Graph& graph, int startVertex, int endVertex){
-		double newEnergy = calculateASPL(graph, startVertex, endVertex).aspl;
+	//Calculates the energy from the cached distances. Distributed, must be called from each process of the chain
+	double calculateEnergy(const DistanceCache& cache, const Options& options, mpi::Comm::Comm comm){
+		double newEnergy = localEnergy(cache, options);
 		double totalEnergy;
 		//Sum results and distrbute them back to all other processes
-		MPI_Allreduce(&newEnergy, &totalEnergy, 1, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+		mpi::allReduce(&newEnergy, &totalEnergy, 1, mpi::Op::Sum, comm);
 		return totalEnergy;
 	};
 
+	/*
+	* Returns a generator that gives the same values on every process of the chain, seeded from process 0.
+	* Drawing the acceptance thresholds from it lets each process decide every step for itself, without
+	* being sent the value. Must be called from every process of the chain.
+	*/
+	Random chainGenerator(int rank, mpi::Comm::Comm comm){
+		int seed;
+		if(rank == 0){
+			seed = randomGenerator.next<int>();
+		}
+		mpi::broadcast(&seed, 0, comm);
+		return Random{seed};
+	};
+
+	//Chooses the next step's move from the graph, which is left unchanged
+	void chooseMoves(const Graph& graph, const Symmetry& symmetry, Array<Move>& moves){
+		if(symmetry.symmetric()){
+			chooseOrbitMove(graph, symmetry, moves);
+		} else{
+			moves.assign(1, chooseMove(graph));
+		}
+	};
+
+	//Builds the move process 0 chose from the edges and swap type it sent
+	void makeMoves(const int picks[3], const Graph& graph, const Symmetry& symmetry, Array<Move>& moves){
+		if(symmetry.symmetric()){
+			makeOrbitMove(picks[0], picks[1], bool(picks[2]), graph, symmetry, moves);
+		} else{
+			moves.assign(1, makeMove(picks[0], picks[1], bool(picks[2]), graph));
+		}
+	};
+
 	//Calculate the Metropolis criterion
 	double metropolis(double deltaE, double T){
 		if(deltaE < 0){
@@ -63,8 +119,122 @@ namespace APSP{
 		}
 	};
 
-	//Finds a new layout of connections using SA and BFS
-	Graph simulatedAnnealing(Graph graph, int rank, [[maybe_unused]] int size, int startVertex, int endVertex){
+	/*
+	* Speculative evaluation of several steps at once. One candidate move is chosen for each temperature,
+	* all from the current graph, and each is evaluated on its own copy of the graph by a separate thread.
+	* The first candidate in order that passes the Metropolis criterion is applied to the graph and every
+	* copy. The candidates before it were rejected, leaving the graph as it was, so each was chosen and
+	* judged exactly as it would have been one step at a time; the ones after it are thrown away.
+	* Returns the number of steps used, whether the last was accepted, and the energy after them.
+	* Distributed, must be called from each process of the chain.
+	*/
+	auto speculativeSteps(
+		Graph& graph,
+		Array<Graph>& copies,
+		const Array<double>& temperatures,
+		double energy,
+		double energyMultiplier,
+		long long perSource,
+		int rank,
+		int startVertex,
+		int endVertex,
+		const Options& options,
+		const Symmetry& symmetry,
+		const SharedGraph& shared,
+		Random& acceptance,
+		SourceBalance& balance,
+		Telemetry& telemetry,
+		mpi::Comm::Comm comm
+	){
+		struct Result{ int steps = 0; bool accepted = false; double energy = 0; };
+		int count = (int)temperatures.size();
+		//Kept between calls so the candidates don't allocate
+		static Array<Array<Move>> candidates;
+		candidates.resize(count);
+
+		//The edges and swap type of each candidate, sent together
+		Array<int> picks(3 * count);
+		//Time process 0 spends choosing the candidates, which the others wait for
+		double choosing = 0;
+		if(rank == 0){
+			double started = omp_get_wtime();
+			for(int i = 0; i != count; ++i){
+				chooseMoves(graph, symmetry, candidates[i]);
+				picks[3 * i] = candidates[i][0].A;
+				picks[3 * i + 1] = candidates[i][0].B;
+				picks[3 * i + 2] = candidates[i][0].swapType;
+			}
+			choosing = omp_get_wtime() - started;
+		}
+		telemetry.lap(Phase::Moves);
+		mpi::broadcast(picks.data(), 3 * count, 0, comm);
+		telemetry.lap(Phase::Broadcast);
+		if(rank != 0){
+			//The copies match the graph, and unlike a shared graph can't be part way through a change
+			for(int i = 0; i != count; ++i){
+				makeMoves(&picks[3 * i], copies.front(), symmetry, candidates[i]);
+			}
+		}
+		telemetry.lap(Phase::Moves);
+		//The random value each candidate will be judged against, the same on every process
+		Array<double> thresholds(count);
+		for(auto& t : thresholds){ t = acceptance.nextProb(); }
+
+		//Each candidate is searched by a single thread, which stops as soon as it must be rejected
+		double searching = omp_get_wtime();
+		Array<double> energies(count);
+	#pragma omp parallel for schedule(dynamic, 1)
+		for(int i = 0; i < count; ++i){
+			auto& copy = copies[i];
+			applyMoves(candidates[i], copy);
+			double maxEnergy = energy - temperatures[i] * log(thresholds[i]) / energyMultiplier;
+			auto cutoff = energyCutoff(graph.order(), endVertex - startVertex, perSource, options, maxEnergy);
+			energies[i] = localEnergy(copy, startVertex, endVertex, options, cutoff);
+			revertMoves(candidates[i], copy);
+		}
+		double searched = omp_get_wtime();
+		balance.record(searched - searching, choosing);
+		telemetry.lap(Phase::Search);
+		//One reduction covers every candidate
+		mpi::allReduce(energies.data(), count, mpi::Op::Sum, comm);
+		telemetry.lap(Phase::Reduce);
+
+		for(int i = 0; i != count; ++i){
+			double deltaE = energyMultiplier * (energies[i] - energy);
+			if(metropolis(deltaE, temperatures[i]) >= thresholds[i]){
+				if(shared.writer()){ applyMoves(candidates[i], graph); }
+				for(auto& copy : copies){
+					applyMoves(candidates[i], copy);
+				}
+				return Result{i + 1, true, energies[i]};
+			}
+		}
+		return Result{count, false, energy};
+	};
+
+	/*
+	* Finds a new layout of connections using SA and BFS. The balance holds the sources of each process in
+	* the chain, which are shared out again as the chain runs. The chain's state is saved by checkpoints,
+	* and carries on from the one it holds if the run was resumed. How the chain is going is logged by the
+	* telemetry, if it was built in. The energy can be estimated from a sample of the sources until the
+	* moves become selective. The vertices can be relabelled for locality as the chain runs, and the graph
+	* returned has the input's labels. With several chains the best graph found by any of them is returned.
+	* The number of iterations run is returned with it, counting any before a resume, as the annealing stops
+	* early if the graph reaches its lower bound.
+	*/
+	auto simulatedAnnealing(
+		Graph graph,
+		SourceBalance& balance,
+		const Options& options,
+		const Symmetry& symmetry,
+		Replicas& replicas,
+		const SharedGraph& shared,
+		Checkpointer& checkpoints,
+		Telemetry& telemetry
+	){
+		//Struct so we can return multiple values
+		struct Result{ Graph graph; int iterations; };
+
 		/*
 		* An implementation of the SA steps from page 3 of "A Method for
 		* Order/Degree Problem Based on Graph Symmetry and Simulated Annealing
@@ -72,59 +242,326 @@ namespace APSP{
 		*/
 
 		//(1) Set initialize parameters
-		double energy = calculateEnergy(graph, startVertex, endVertex); //Calculate the intial energy.
-		int energyMultiplier = graph.v.size() * (graph.v.size() - 1);
+		//The distances from this process's sources are cached if enabled and they fit in memory
+		//Speculative steps search copies of the graph, which the cache can't follow. With a shared graph
+		//only one process on each node sees the moves being made, so the others can't update a cache.
+		bool speculative = options.speculative > 1;
+		//The energy is estimated from a sample of the sources until the moves become selective, and the
+		//cache is only built once it is found exactly. A resumed run carries on in the mode it was saved in.
+		bool sampling = options.sampleFraction > 0 && !speculative && (!checkpoints.resumed || checkpoints.resumed->sampling);
+		int rank = balance.rank;
+		//The label each vertex had in the input, once the graph has been reordered. The graph is reordered
+		//before anything is built from it, unless the run being resumed already was.
+		Array<int> original;
+		if(checkpoints.resumed){
+			original = checkpoints.resumed->original;
+		} else if(options.reorder){
+			reorder(graph, original, {}, shared);
+		}
+		//Each process's share of the energy is rounded on its own, so a resumed run searches the same sources
+		//it was saved with to make the same choices. A run on a different number of processes can't.
+		if(checkpoints.resumed && checkpoints.resumed->starts.size() == balance.starts.size() && checkpoints.resumed->starts.back() == balance.starts.back()){
+			balance.starts = checkpoints.resumed->starts;
+		}
+		int startVertex = balance.start();
+		int endVertex = balance.end();
+		bool cached = false;
+		std::optional<DistanceCache> cache;
+		//Called again whenever this process's sources change
+		auto buildCache = [&]{
+			cached = !speculative && !sampling && !shared.shared && options.incremental && (long long)(endVertex - startVertex) * graph.order() * (long long)sizeof(uint16_t) <= options.cacheLimit;
+			cache.reset();
+			if(cached){
+				cache.emplace(graph, startVertex, endVertex);
+			}
+		};
+		buildCache();
+		auto comm = replicas.comm;
+		//Calculate the intial energy. A sampled energy is first estimated when the sample is drawn.
+		double energy = sampling ? 0 : cached ? calculateEnergy(*cache, options, comm) : calculateEnergy(graph, startVertex, endVertex, options, comm);
+		double energyMultiplier = graph.order() * (graph.order() - 1.0);
 		double T = 100; //Start temperature
 		double C = 0.22; //End temperature
 		int I = 1; //Repetitions for cooling process
 		int N = 1000; //Total number of calculations
 		double alpha = pow(C / T, double(I) / N); //Scalling factor for T
 		int iters = 0; //Current number of iterations
+		//Lower bound on the total distance from any one source, used to stop searches early
+		int maxDegree = 0;
+		for(int v = 0; v != graph.order(); ++v){
+			maxDegree = std::max(maxDegree, graph.degree(v));
+		}
+		long long perSource = mooreBound(graph.order(), maxDegree);
+		//The lowest ASPL any graph of this order and degree can have, which a graph reaching can't be improved on
+		double lowerBound = double(perSource) / (graph.order() - 1);
+		//The sample the energy is estimated from, drawn again every sampleWindow iterations, the moves accepted
+		//in the current window, and the last estimate
+		int sources = graph.order() / options.symmetry;
+		SourceSample sample;
+		int windowAccepted = 0;
+		SampledEnergy estimate{};
+		Array<Move> moves; //The moves making up the current step
+		//Every process of the chain draws the same acceptance thresholds
+		auto acceptance = chainGenerator(rank, comm);
+		//A resumed run carries on from the temperature, iteration and random values it was saved at
+		if(checkpoints.resumed){
+			auto& state = *checkpoints.resumed;
+			T = state.T;
+			iters = state.iters;
+			if(rank == 0){ randomGenerator.restore(state.generator); }
+			acceptance.restore(state.acceptance);
+			replicas.generator.restore(state.exchanges);
+			replicas.slot = state.slot;
+			replicas.attempts = state.attempts;
+			replicas.swaps = state.swaps;
+			windowAccepted = state.windowAccepted;
+		}
+		/*
+		* Process 0 chooses the next step's move while the energies are being summed, as if this step is
+		* rejected, which most are. It can only step back to the graph from before the move on its own
+		* copy, as a shared graph may still be being searched by the others. If the step is accepted the
+		* move chosen is thrown away, and a new one chosen as normal.
+		*/
+		bool overlap = rank == 0 && !shared.shared;
+		bool prepared = false;
+		Array<Move> nextMoves;
+		//Time process 0 has spent choosing moves since it last recorded a search, wherever it chose them.
+		//The other processes wait for the move, so it is the only work besides the search the balance counts.
+		double choosing = 0;
+		//Process 0's generator from before the next move was prepared, which a checkpoint must hold as a resumed run chooses it again
+		Random unprepared = randomGenerator;
+		//Copies the state for the checkpoint, which is written while the annealing carries on
+		auto checkpoint = [&]{
+			if(!checkpoints.writer){ return; }
+			checkpoints.save(Checkpoint{
+				Array<Edge>(graph.e.begin(), graph.e.end()), T, iters, energy,
+				(prepared ? unprepared : randomGenerator).state(), acceptance.state(), replicas.generator.state(), replicas.slot, replicas.attempts, replicas.swaps,
+				sampling, windowAccepted, balance.starts, original
+			});
+		};
+		//A copy of the graph for each speculative candidate
+		Array<Graph> copies(speculative ? options.speculative : 0, graph);
+		/*
+		* Relabels the vertices again, as the moves change which are neighbours. Everything built from the
+		* labels is built again, and a move process 0 has prepared is relabelled with the graph. The exact
+		* energy doesn't depend on the labels, but a sampled one does, so it is estimated again.
+		*/
+		auto relabelVertices = [&]{
+			reorder(graph, original, moves, shared);
+			for(auto& copy : copies){ copy = graph; }
+			buildCache();
+			if(sampling && !sample.sources.empty()){
+				estimate = sampledEnergy(graph, sample, startVertex, endVertex, options, comm);
+				energy = estimate.energy;
+			}
+		};
+		auto relabelDue = [&]{
+			return options.reorderInterval && iters % options.reorderInterval == 0;
+		};
+		/*
+		* Returns true once the exact energy of any chain has reached the lower bound, when the annealing
+		* stops. A single chain checks after every step. Several only check together, on the iterations they
+		* exchange temperatures, so each must call this on those iterations.
+		*/
+		auto reachedBound = [&]{
+			if(replicas.count > 1 && iters % replicas.interval != 0){ return false; }
+			return replicas.any(!sampling && energy <= lowerBound * (1 + 1e-9));
+		};
+		bool bounded = replicas.count == 1 && reachedBound();
+
+		telemetry.start();
+		while(!bounded){
+			//Saving the last checkpoint is part of the step before
+			telemetry.lap(Phase::Other);
+			if(speculative){
+				//(2) to (5) for several steps at once, each at the temperature it would have been made at
+				Array<double> temperatures;
+				double t = T;
+				for(int i = iters; i != N && (int)temperatures.size() != options.speculative; ++i){
+					temperatures.push_back(t * replicas.scale());
+					if(i % I == 0){ t *= alpha; }
+					if(t <= C){ break; }
+				}
+				auto step = speculativeSteps(
+					graph, copies, temperatures, energy, energyMultiplier, perSource,
+					rank, startVertex, endVertex, options, symmetry, shared, acceptance, balance, telemetry, comm
+				);
+				energy = step.energy;
+				telemetry.step(step.steps, step.accepted, energy);
+
+				//(6) and (7) for each step used. The graph already holds every step, so a checkpoint or a
+				//line of telemetry is only saved after the last of them.
+				bool saving = false;
+				bool logging = false;
+				bool relabelling = false;
+				for(int i = 0; i != step.steps; ++i){
+					if(iters % I == 0){
+						T *= alpha;
+					}
+					++iters;
+					if(iters % replicas.interval == 0){
+						replicas.exchange(energyMultiplier * energy, T, iters / replicas.interval);
+					}
+					if(options.balanceInterval && iters % options.balanceInterval == 0 && balance.rebalance()){
+						startVertex = balance.start();
+						endVertex = balance.end();
+					}
+					saving = saving || checkpoints.due(iters);
+					logging = logging || telemetry.due(iters);
+					relabelling = relabelling || relabelDue();
+					//The graph already holds the rest of the steps, but they needn't be counted
+					bounded = reachedBound();
+					if(bounded){ break; }
+				}
+				if(relabelling){ relabelVertices(); }
+				telemetry.lap(Phase::Other);
+				if(logging){
+					telemetry.log(graph, startVertex, endVertex, options, shared, iters, T, energy, comm);
+				}
+
+				//(8) Terminal, or once the graph can't be improved on
+				if(T <= C || iters == N || bounded){
+					break;
+				}
+				if(saving){ checkpoint(); }
+				continue;
+			}
+
+			/*
+			* A new sample is drawn at the start of each window, and the energy of the graph estimated from it.
+			* Every step in the window is judged against the same sample, so only the moves make the energy
+			* change. Once fewer than selectiveAcceptance of the last window's moves were accepted, or the
+			* sample would hold every source, the energy is found exactly from then on. A resumed run draws
+			* the sample it was saved with again, which gives the same estimate.
+			*/
+			if(sampling && (iters % sampleWindow == 0 || sample.sources.empty())){
+				//The sample's size is set at the start of its window, which a resumed run may be part way through
+				int window = iters / sampleWindow;
+				int count = (int)std::ceil(sampleFraction(options.sampleFraction, window * sampleWindow, N) * sources);
+				bool windowEnded = iters % sampleWindow == 0 && iters != 0;
+				if((windowEnded && windowAccepted < selectiveAcceptance * sampleWindow) || count >= sources){
+					sampling = false;
+					if(rank == 0){
+						printf(
+							"Chain %d switched to exact energies at iteration %d, where the sampled ASPL had a standard deviation of %g.\n",
+							replicas.chain, iters, std::sqrt(estimate.variance)
+						);
+					}
+					buildCache();
+					energy = cached ? calculateEnergy(*cache, options, comm) : calculateEnergy(graph, startVertex, endVertex, options, comm);
+				} else{
+					if(windowEnded){ windowAccepted = 0; }
+					sample = drawSample(sources, count, options.sampleSeed + window);
+					estimate = sampledEnergy(graph, sample, startVertex, endVertex, options, comm);
+					energy = estimate.energy;
+				}
+				telemetry.lap(Phase::Search);
+			}
 
-		for(;;){
 			//(2) Generate next solution
-			auto newGraph = graph;
-			int edgeA;
-			int edgeB;
-			int swapTypeInt;
+			//The move is made in place, and reverted if it isn't accepted, so the graph is never copied.
+			//With symmetry the move is the same exchange applied to every rotation of the two edges.
+			//Both edges and the swap type are sent to every other process in one message.
+			int picks[3];
 			if(rank == 0){
 				//The exchange with verification only needs to be done in the root process
-				auto [A, B, sT] = edgeExchange(newGraph);
-				edgeA = A;
-				edgeB = B;
-				swapTypeInt = sT;
+				if(!prepared){
+					double started = omp_get_wtime();
+					chooseMoves(graph, symmetry, moves);
+					choosing += omp_get_wtime() - started;
+				}
+				prepared = false;
+				picks[0] = moves[0].A;
+				picks[1] = moves[0].B;
+				picks[2] = moves[0].swapType;
 			}
+			telemetry.lap(Phase::Moves);
+			mpi::broadcast(picks, 3, 0, comm);
+			telemetry.lap(Phase::Broadcast);
 
-			//Send the swapped edges and swap type to all other processes.
-			//Alternatively, this could have been done using an int array of size 3.
-			mpi::broadcast(&edgeA, 0);
-			mpi::broadcast(&edgeB, 0);
-			mpi::broadcast(&swapTypeInt, 0);
-
-			//If the rank isn't zero we have to update the edges received above
-			if(rank != 0){
-				edgeExchange2opt(edgeA, edgeB, newGraph, bool(swapTypeInt));
+			//If the rank isn't zero we have to build the move from the edges received above. With a shared
+			//graph only the process making the changes needs it.
+			if(rank != 0 && shared.writer()){
+				makeMoves(picks, graph, symmetry, moves);
 			}
+			if(shared.writer()){
+				applyMoves(moves, graph);
+			}
+			//The other processes sharing the graph can't search it until the move is made
+			shared.sync();
+			telemetry.lap(Phase::Moves);
 
 			//(3) Compute energy
-			//Calculate and reduce the energy from each process
-			double newEnergy = calculateEnergy(newGraph, startVertex, endVertex);
+			//The random value for the acceptance is drawn first, which sets the largest energy that can
+			//be accepted. The searches stop as soon as the new energy is known to be larger.
+			double threshold = acceptance.nextProb();
+			//Each chain runs at its own share of the cooling temperature
+			double chainT = T * replicas.scale();
+			double maxEnergy = energy - chainT * log(threshold) / energyMultiplier;
+			auto cutoff = energyCutoff(graph.order(), endVertex - startVertex, perSource, options, maxEnergy);
+
+			//Calculate this process's share of the energy, and start summing them
+			double searching = omp_get_wtime();
+			double localE = 0;
+			SampleSums localSums{};
+			if(sampling){
+				localSums = localSampleSums(graph, sample, startVertex, endVertex);
+			} else if(cached){
+				cache->update(graph, moves, cutoff);
+				localE = localEnergy(*cache, options);
+			} else{
+				localE = localEnergy(graph, startVertex, endVertex, options, cutoff);
+			}
+			double searched = omp_get_wtime();
+			balance.record(searched - searching, choosing, sampling ? sample.countIn(startVertex, endVertex) : endVertex - startVertex);
+			choosing = 0;
+			telemetry.lap(Phase::Search);
+			double newEnergy;
+			SampleSums sums{};
+			auto reduction = sampling ?
+				mpi::iAllReduce(&localSums.weighted, &sums.weighted, 3, mpi::Op::Sum, comm) :
+				mpi::iAllReduce(&localE, &newEnergy, 1, mpi::Op::Sum, comm);
+			if(overlap){
+				//The cache has already been updated, so the graph can be stepped back while waiting
+				revertMoves(moves, graph);
+				if(checkpoints.due(iters + 1)){ unprepared = randomGenerator; }
+				double started = omp_get_wtime();
+				chooseMoves(graph, symmetry, nextMoves);
+				choosing += omp_get_wtime() - started;
+			}
+			reduction.wait();
+			telemetry.lap(Phase::Reduce);
+			if(sampling){
+				auto next = sampledEnergy(sums, sample, graph.order(), options);
+				newEnergy = next.energy;
+				estimate.variance = next.variance;
+			}
 
 			double deltaE = energyMultiplier * (newEnergy - energy);
 
 			//(4) Acceptance
-			int accepted = 0;
-			//Only calculate the random value in process 0
-			if(rank == 0){
-				accepted = metropolis(deltaE, T) >= randomGenerator.nextProb();
-			}
-			mpi::broadcast(&accepted, 0);
+			//Every process has the same energy and random value, so they all make the same decision
+			bool accepted = metropolis(deltaE, chainT) >= threshold;
 			
 			if(accepted){
 				//(5) Transition
-				std::swap(graph, newGraph);
 				energy = newEnergy;
+				if(sampling){ ++windowAccepted; }
+				if(cached){ cache->commit(); }
+				if(overlap){ applyMoves(moves, graph); }
+			} else{
+				//Rejected, so return to the previous graph. The energy reduction above means every process
+				//sharing the graph has finished searching it.
+				if(shared.writer() && !overlap){
+					revertMoves(moves, graph);
+				}
+				if(cached){ cache->rollback(); }
+				if(overlap){
+					std::swap(moves, nextMoves);
+					prepared = true;
+				}
 			}
+			telemetry.step(1, accepted, energy);
 
 			//(6) Cooling cycle
 			if(iters % I == 0){
@@ -134,12 +571,128 @@ namespace APSP{
 
 			++iters;
 
-			//(8) Terminal
-			if(T <= C || iters == N){
+			//Chains at neighbouring temperatures may swap them
+			if(iters % replicas.interval == 0){
+				replicas.exchange(energyMultiplier * energy, T, iters / replicas.interval);
+			}
+
+			//Share the sources out again from how long each process took. Every process's graph matches
+			//here, so the cache can be rebuilt for the new sources.
+			if(options.balanceInterval && iters % options.balanceInterval == 0 && balance.rebalance()){
+				startVertex = balance.start();
+				endVertex = balance.end();
+				buildCache();
+			}
+
+			if(relabelDue()){ relabelVertices(); }
+
+			telemetry.lap(Phase::Other);
+			if(telemetry.due(iters)){
+				telemetry.log(graph, startVertex, endVertex, options, shared, iters, T, energy, comm);
+			}
+
+			//(8) Terminal, or once the graph can't be improved on
+			bounded = reachedBound();
+			if(T <= C || iters == N || bounded){
 				break;
 			}
+
+			//A finished run needs no checkpoint, so one is only saved if there is more to do
+			if(checkpoints.due(iters)){ checkpoint(); }
+		}
+
+		checkpoints.finish();
+		if(bounded && mpi::Comm::rank(replicas.all) == 0){
+			printf("The ASPL reached its lower bound of %f at iteration %d, so the annealing stopped early.\n", lowerBound, iters);
 		}
+		restoreLabels(graph, original, shared);
+		return Result{replicas.best(graph, energy), iters};
+	};
 
-		return graph;
+	//Calculates the energy of a distributed graph. Every process of the graph's communicator searches from every source together.
+	double calculateEnergy(const DistributedGraph& graph, Cutoff cutoff = {}){
+		return distributedASPL(graph, cutoff).aspl;
+	};
+
+	/*
+	* The same annealing as simulatedAnnealing, on a graph split between the processes of the chain rather
+	* than copied to each of them. Every process takes part in choosing each move and in every search.
+	* The graph is annealed in place, as no process could hold the whole of it, and the chain's final
+	* energy is returned, so the best chain can be found with replicas.bestChain.
+	*/
+	double distributedAnnealing(DistributedGraph& graph, const Options& options, Replicas& replicas){
+		//(1) Set initialize parameters
+		double energy = calculateEnergy(graph); //Calculate the intial energy.
+		double energyMultiplier = graph.order() * (graph.order() - 1.0);
+		double T = 100; //Start temperature
+		double C = 0.22; //End temperature
+		int I = 1; //Repetitions for cooling process
+		int N = 1000; //Total number of calculations
+		double alpha = pow(C / T, double(I) / N); //Scalling factor for T
+		int iters = 0; //Current number of iterations
+		//Lower bound on the total distance from any one source, used to stop searches early.
+		//Only the owners know each vertex's degree, so the largest is shared.
+		int maxDegree = 0;
+		for(int v = graph.first(); v != graph.last(); ++v){
+			maxDegree = std::max(maxDegree, (int)graph.neighbours(v).size());
+		}
+		mpi::allReduce(&maxDegree, 1, mpi::Op::Max, graph.comm);
+		long long perSource = mooreBound(graph.order(), maxDegree);
+		//The lowest ASPL any graph of this order and degree can have, checked as in simulatedAnnealing
+		double lowerBound = double(perSource) / (graph.order() - 1);
+		auto reachedBound = [&]{
+			if(replicas.count > 1 && iters % replicas.interval != 0){ return false; }
+			return replicas.any(energy <= lowerBound * (1 + 1e-9));
+		};
+		bool bounded = replicas.count == 1 && reachedBound();
+		auto acceptance = chainGenerator(graph.rank, graph.comm);
+
+		while(!bounded){
+			//(2) Generate next solution
+			auto move = chooseMove(graph);
+			applyMove(move, graph);
+
+			//(3) Compute energy, stopping early once the move can't be accepted
+			double threshold = acceptance.nextProb();
+			double chainT = T * replicas.scale();
+			double maxEnergy = energy - chainT * log(threshold) / energyMultiplier;
+			//Every source is searched by every process, so none are left to other processes
+			auto cutoff = energyCutoff(graph.order(), graph.order(), perSource, options, maxEnergy);
+			double newEnergy = calculateEnergy(graph, cutoff);
+			double deltaE = energyMultiplier * (newEnergy - energy);
+
+			//(4) Acceptance
+			if(metropolis(deltaE, chainT) >= threshold){
+				//(5) Transition
+				energy = newEnergy;
+			} else{
+				//Rejected, so return to the previous graph
+				revertMove(move, graph);
+			}
+
+			//(6) Cooling cycle
+			if(iters % I == 0){
+				//(7) Cooling
+				T *= alpha;
+			}
+
+			++iters;
+
+			//Chains at neighbouring temperatures may swap them
+			if(iters % replicas.interval == 0){
+				replicas.exchange(energyMultiplier * energy, T, iters / replicas.interval);
+			}
+
+			//(8) Terminal, or once the graph can't be improved on
+			bounded = reachedBound();
+			if(T <= C || iters == N || bounded){
+				break;
+			}
+		}
+
+		if(bounded && mpi::Comm::rank(replicas.all) == 0){
+			printf("The ASPL reached its lower bound of %f at iteration %d, so the annealing stopped early.\n", lowerBound, iters);
+		}
+		return energy;
 	};
 };
\ No newline at end of file
@@ -0,0 +1,166 @@
+#pragma once
+#include "./core.h"
+#include "./Graph.h"
+#include "./edgeExchange.h"
+
+#include <algorithm>
+#include <optional>
+
+namespace APSP{
+	/*
+	* The g-fold rotational symmetry of a graph, as used in "A Method for Order/Degree Problem Based on
+	* Graph Symmetry and Simulated Annealing with MPI/OpenMP Parallelization".
+	* With n = g * k vertices, the rotation maps vertex v to v + k (mod n). The graph is symmetric if the
+	* rotation maps its edges onto themselves, so the vertices 0 to k - 1 represent every vertex, and the
+	* edges fall into orbits of g edges that are rotations of each other.
+	*/
+	struct Symmetry{
+		//Number of rotations, 1 meaning the graph isn't treated as symmetric
+		int g = 1;
+		//Number of representative vertices, and the distance each rotation moves a vertex
+		int k = 0;
+		int order = 0;
+		//The orbit each edge belongs to, and how many rotations of the orbit's first edge it is
+		Array<int> orbit;
+		Array<int> position;
+		//The edges of each orbit, where orbits[o][r] is r rotations of orbits[o][0]
+		Array<Array<int>> orbits;
+
+		//Returns true if moves and energy should use the symmetry
+		bool symmetric() const{
+			return g > 1;
+		};
+
+		//Returns the edge rotated r times
+		Edge rotate(Edge edge, int r) const{
+			Edge result{(edge.first + r * k) % order, (edge.second + r * k) % order};
+			result.sort();
+			return result;
+		};
+
+		//Returns true if the edge's orbit holds g different edges, so it can be used in a move
+		bool full(int edge) const{
+			return (int)orbits[orbit[edge]].size() == g;
+		};
+	};
+
+	//Orders edges by their first then second vertex
+	bool edgeLess(const Edge& a, const Edge& b){
+		return a.first != b.first ? a.first < b.first : a.second < b.second;
+	};
+
+	/*
+	* Finds the orbits of the graph's edges under g-fold rotation.
+	* Returns nothing if the order isn't a multiple of g, or the graph isn't symmetric.
+	*/
+	std::optional<Symmetry> findSymmetry(const Graph& graph, int g){
+		Symmetry symmetry{};
+		symmetry.g = g;
+		symmetry.order = graph.order();
+		if(g < 1 || graph.order() % g != 0){ return std::nullopt; }
+		symmetry.k = graph.order() / g;
+		//Every graph is symmetric under a single rotation, and no orbits are needed
+		if(g == 1){ return symmetry; }
+
+		//The input files don't always list an edge's vertices in order, so compare sorted copies
+		Array<Edge> edges(graph.e.begin(), graph.e.end());
+		for(auto& edge : edges){ edge.sort(); }
+
+		//Sorted edge indices so each rotated edge can be found by a binary search
+		Array<int> sorted(edges.size());
+		for(uint i = 0; i != sorted.size(); ++i){ sorted[i] = i; }
+		std::sort(sorted.begin(), sorted.end(), [&](int a, int b){ return edgeLess(edges[a], edges[b]); });
+		auto find = [&](const Edge& edge){
+			auto it = std::lower_bound(sorted.begin(), sorted.end(), edge, [&](int i, const Edge& e){
+				return edgeLess(edges[i], e);
+			});
+			return (it != sorted.end() && edges[*it] == edge) ? *it : -1;
+		};
+
+		symmetry.orbit.assign(graph.e.size(), -1);
+		symmetry.position.assign(graph.e.size(), 0);
+		for(uint i = 0; i != graph.e.size(); ++i){
+			if(symmetry.orbit[i] != -1){ continue; }
+			int o = (int)symmetry.orbits.size();
+			symmetry.orbits.push_back({});
+			for(int r = 0; r != g; ++r){
+				int j = find(symmetry.rotate(edges[i], r));
+				//Every rotation of an edge must also be an edge
+				if(j == -1){ return std::nullopt; }
+				//Edges that map onto themselves before g rotations make a smaller orbit
+				if(symmetry.orbit[j] == o){ break; }
+				symmetry.orbit[j] = o;
+				symmetry.position[j] = r;
+				symmetry.orbits[o].push_back(j);
+			}
+		}
+		return symmetry;
+	};
+
+	/*
+	* Builds the exchange of the edges a and b applied to every rotation of them, as one move per rotation.
+	* The new edges are the rotations of the exchange of a and b, which keeps the graph symmetric.
+	*/
+	void makeOrbitMove(int a, int b, bool swapType, const Graph& graph, const Symmetry& symmetry, Array<Move>& moves){
+		moves.clear();
+		auto [nA, nB] = edgeExchange(graph.e[a], graph.e[b], swapType);
+		auto& orbitA = symmetry.orbits[symmetry.orbit[a]];
+		auto& orbitB = symmetry.orbits[symmetry.orbit[b]];
+		for(int r = 0; r != symmetry.g; ++r){
+			int A = orbitA[(symmetry.position[a] + r) % symmetry.g];
+			int B = orbitB[(symmetry.position[b] + r) % symmetry.g];
+			moves.push_back(Move{A, B, swapType, graph.e[A], graph.e[B], symmetry.rotate(nA, r), symmetry.rotate(nB, r)});
+		}
+	};
+
+	//Returns true if the moves would leave an edge duplicated. Only the neighbours of the new edges' end points are read.
+	bool isMultigraph(const Array<Move>& moves, const Graph& graph, Array<Edge>& added){
+		added.clear();
+		for(auto& move : moves){
+			added.push_back(move.newA);
+			added.push_back(move.newB);
+		}
+		std::sort(added.begin(), added.end(), edgeLess);
+		//The new edges can't repeat each other
+		if(std::adjacent_find(added.begin(), added.end()) != added.end()){ return true; }
+
+		//Or any edge that isn't being removed
+		for(auto& edge : added){
+			if(!graph.hasEdge(edge)){ continue; }
+			bool removed = false;
+			for(auto& move : moves){
+				for(auto old : {move.oldA, move.oldB}){
+					old.sort();
+					removed = removed || old == edge;
+				}
+			}
+			if(!removed){ return true; }
+		}
+		return false;
+	};
+
+	/*
+	* Chooses an exchange of two whole orbits of edges that leaves the graph valid and symmetric, and
+	* stores it in moves. The graph itself is left unchanged.
+	*/
+	void chooseOrbitMove(const Graph& graph, const Symmetry& symmetry, Array<Move>& moves){
+		//Kept between calls so choosing a move doesn't allocate
+		static Array<Edge> added;
+		int A;
+		int B;
+		bool swapType = false;
+		do{
+			do{
+				//Choose two random edges from different full orbits
+				A = randomGenerator.next<int>() % graph.e.size();
+				B = randomGenerator.next<int>() % graph.e.size();
+			} while(
+				symmetry.orbit[A] == symmetry.orbit[B] ||
+				!symmetry.full(A) || !symmetry.full(B) ||
+				duplicatedVertex(A, B, graph)
+			);
+			swapType = randomGenerator.next<bool>(); //Choose a swapping method
+			makeOrbitMove(A, B, swapType, graph, symmetry, moves);
+		} while(isMultigraph(moves, graph, added));
+	};
+};
\ No newline at end of file
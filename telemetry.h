@@ -0,0 +1,161 @@
+#pragma once
+#include "./mpiWrapper.h"
+#include "./options.h"
+#include "./sharedGraph.h"
+#include "./aspl.h"
+#include "./Graph.h"
+#include "./core.h"
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdio>
+#include <omp.h>
+
+namespace APSP{
+	//Telemetry is only built in when compiled with -DTELEMETRY. Without it every call below does nothing.
+#if defined(TELEMETRY)
+	constexpr bool telemetryEnabled = true;
+#else
+	constexpr bool telemetryEnabled = false;
+#endif
+
+	//The parts of an annealing step that are timed
+	enum class Phase{
+		Moves, //Choosing the move on process 0, and building and making it on the rest
+		Broadcast, //Sending the move from process 0
+		Search, //Searching this process's sources for its share of the energy
+		Reduce, //Summing the energies, which includes the move process 0 prepares while it waits
+		Other, //Deciding, cooling, exchanges, rebalancing and checkpoints
+		Count
+	};
+
+	//Names of the phases, as the columns of the log
+	constexpr const char* phaseNames[(int)Phase::Count] = {"moves", "broadcast", "search", "reduce", "other"};
+
+	/*
+	* Logs how a chain's annealing is going every few iterations, as a line of CSV. Each line holds the
+	* iteration, the temperature, the share of steps accepted since the last line, the current and best
+	* ASPL and diameter, and the seconds the slowest process of the chain spent in each phase since the
+	* last line. The cut off searches of each step don't find the diameter, so every process of the chain
+	* searches its sources again in full whenever a line is logged, which isn't counted in the phases.
+	*/
+	struct Telemetry{
+		string path;
+		//Iterations between lines, 0 for none
+		int interval = 0;
+		//True for the process that writes the log
+		bool writer = false;
+		//Add to the log rather than starting it again, for a resumed run
+		bool append = false;
+		FILE* file = nullptr;
+		//Measured since the last line: the seconds in each phase, the steps taken and those accepted
+		double phases[(int)Phase::Count] = {};
+		int steps = 0;
+		int accepted = 0;
+		//The end of the last phase timed
+		double mark = 0;
+		//The lowest ASPL of any step, and the lowest diameter of any line
+		double bestASPL = INFINITY;
+		int bestDiameter = INT_MAX;
+
+		Telemetry() = default;
+		Telemetry(const Telemetry&) = delete;
+		Telemetry& operator=(const Telemetry&) = delete;
+
+		//Returns true if anything is being measured
+		bool active() const{
+			return telemetryEnabled && interval != 0;
+		};
+
+		//Returns true if a line should be logged after this many iterations
+		bool due(int iters) const{
+			return active() && iters % interval == 0;
+		};
+
+		//Starts timing the next phase from now
+		void start(){
+			if constexpr(telemetryEnabled){
+				if(interval){ mark = omp_get_wtime(); }
+			}
+		};
+
+		//Adds the time since the last phase ended to this one
+		void lap(Phase phase){
+			if constexpr(telemetryEnabled){
+				if(!interval){ return; }
+				double now = omp_get_wtime();
+				phases[(int)phase] += now - mark;
+				mark = now;
+			}
+		};
+
+		//Counts the steps taken, whether the last of them was accepted, and the energy after them
+		void step(int count, bool accept, double energy){
+			if constexpr(telemetryEnabled){
+				steps += count;
+				accepted += accept;
+				bestASPL = std::min(bestASPL, energy);
+			}
+		};
+
+		/*
+		* Logs a line for the graph as it stands after this many iterations, then starts measuring the next.
+		* Must be called from every process of the chain when a line is due.
+		*/
+		void log(
+			const Graph& graph,
+			int startVertex,
+			int endVertex,
+			const Options& options,
+			const SharedGraph& shared,
+			int iters,
+			double T,
+			double energy,
+			mpi::Comm::Comm comm
+		){
+			if constexpr(telemetryEnabled){
+				//The writer of a shared graph mustn't change it until every process has searched it
+				shared.sync();
+				auto [aspl, diameter] = calculateASPL(graph, startVertex, endVertex, options.engine, options.bfsMode);
+				shared.sync();
+				//A disconnected graph has no diameter
+				if(std::isinf(aspl)){ diameter = INT_MAX; }
+				mpi::allReduce(&diameter, 1, mpi::Op::Max, comm);
+				mpi::allReduce(phases, (int)Phase::Count, mpi::Op::Max, comm);
+				bestDiameter = std::min(bestDiameter, diameter);
+
+				if(writer){
+					if(!file){
+						file = fopen(path.c_str(), append ? "a" : "w");
+					}
+					if(file){
+						if(ftell(file) == 0){
+							fprintf(file, "iteration,temperature,acceptance,aspl,best_aspl,diameter,best_diameter");
+							for(auto name : phaseNames){ fprintf(file, ",%s", name); }
+							fprintf(file, "\n");
+						}
+						//-1 stands for the diameter of a disconnected graph
+						auto shown = [](int d){ return d == INT_MAX ? -1 : d; };
+						fprintf(
+							file, "%d,%g,%g,%.9g,%.9g,%d,%d", iters, T, steps ? double(accepted) / steps : 0.0,
+							energy, bestASPL, shown(diameter), shown(bestDiameter)
+						);
+						for(auto seconds : phases){ fprintf(file, ",%.6f", seconds); }
+						fprintf(file, "\n");
+						fflush(file);
+					}
+				}
+
+				std::fill(std::begin(phases), std::end(phases), 0.0);
+				steps = 0;
+				accepted = 0;
+				start();
+			}
+		};
+
+		~Telemetry(){
+			if(file){ fclose(file); }
+		};
+	};
+};
\ No newline at end of file